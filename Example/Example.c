@@ -49,6 +49,9 @@ extern uVectorEntry __vector_table;
 #endif
 
 unsigned long CurrentLux;
+tLcdWidget CounterBar;
+tLcdField CounterField;
+long CounterValue;
 //*****************************************************************************
 //                 GLOBAL VARIABLES -- End
 //*****************************************************************************
@@ -174,14 +177,22 @@ void main()
 
     Lcd_clear();
 
+    //
+    // Only the digits that changed since the last flush go to the lcd,
+    // Lcd_service formats the counter field when its value changes
+    //
+    Lcd_framebuffer(ENABLE);
     Lcd_gotoxy(1,0);
     Lcd_Print("Counter: ");
+    Lcd_field_add(&CounterField, 11, 0, 2, "%2ld", LCD_FIELD_LONG, &CounterValue, 0);
+    Lcd_bar_create(&CounterBar, LCD_BAR_HORIZONTAL, 0, 1, 16, 1);
     while(1)
     {
         for(iLoopCnt = 0; iLoopCnt < 50; iLoopCnt++)
         {
-            Lcd_gotoxy(11,0);
-        	Lcd_Print("%2d",iLoopCnt);
+            CounterValue = iLoopCnt;
+        	Lcd_bar_set(&CounterBar, iLoopCnt, 49);
+        	Lcd_service();
         	 SEC_DELAY(0.3);
         }
     }
@@ -0,0 +1,100 @@
+//*****************************************************************************
+//
+// Application Name     - Lcd i2c host example
+// Application Overview - Runs the Example application screens against the
+//                        HD44780/PCF8574T emulator and prints the display,
+//                        the bus usage and the timing violations found
+//
+//*****************************************************************************
+#include <stdio.h>
+
+#include "i2c_if.h"
+#include "i2c_lcd.h"
+#include "lcd_emu.h"
+
+static unsigned long g_ulViolations = 0;
+// emulator time as the driver clock, as TIMERA2 on the board
+static const tLcdClock g_clock = {LcdEmu_micros, LcdEmu_sleep};
+
+//*****************************************************************************
+//
+//! Print the display and the bus counters
+//!
+//! \param title: name of the step
+//!
+//*****************************************************************************
+static void
+ShowStep(const char *title)
+{
+    tLcdEmuStats *pStats = LcdEmu_stats();
+
+    printf("%s\n", title);
+    LcdEmu_render(LCDI2C_ADDRESS, stdout);
+    printf("transactions %lu, bytes %lu, bus %lluus, delays %lluus, "
+           "violations %lu\n\n", pStats->transactions, pStats->bytes,
+           pStats->busNs / 1000, pStats->delayNs / 1000, pStats->violations);
+    g_ulViolations += pStats->violations;
+    LcdEmu_clearStats();
+}
+
+int
+main(void)
+{
+    unsigned char check[8] = {0x0, 0x1, 0x3, 0x16, 0x1c, 0x8, 0x0};
+    tLcdWidget counterBar;
+    tLcdField counterField;
+    long counterValue = 0;
+    int iLoopCnt;
+
+    LcdEmu_attach(LCDI2C_ADDRESS, 16, 2);
+    LcdEmu_reset(100000);
+    I2C_IF_Open(I2C_MASTER_MODE_STD);
+    Lcd_clock(&g_clock);
+#ifdef LCD_STATS
+    Lcd_stats_clock(LcdEmu_micros, 1);
+#endif
+#ifdef LCD_TRACE
+    Lcd_trace(ENABLE);
+#endif
+
+    Lcd_init(16, 2);
+    Lcd_backlight(ENABLE);
+    Lcd_displaycontrol(LCD_DISPLAYON,LCD_CURSOROFF,LCD_BLINKOFF);
+    Lcd_home();
+    Lcd_clear();
+    ShowStep("Init");
+
+    Lcd_createChar(0, check);
+    Lcd_gotoxy(0,0);
+    Lcd_Print("CC3200 Lcd I2C ");
+    Lcd_send_byte(0,DATA);
+    Lcd_gotoxy(0,1);
+    Lcd_Print("FC-113 PCF8574T");
+    ShowStep("Banner");
+
+    Lcd_clear();
+    Lcd_framebuffer(ENABLE);
+    Lcd_gotoxy(1,0);
+    Lcd_Print("Counter: ");
+    Lcd_field_add(&counterField, 11, 0, 2, "%2ld", LCD_FIELD_LONG, &counterValue, 0);
+    Lcd_bar_create(&counterBar, LCD_BAR_HORIZONTAL, 0, 1, 16, 1);
+    for(iLoopCnt = 0; iLoopCnt < 12; iLoopCnt++)
+    {
+        counterValue = iLoopCnt;
+        Lcd_bar_set(&counterBar, iLoopCnt, 49);
+        Lcd_service();
+    }
+    ShowStep("Counter");
+
+#ifdef LCD_STATS
+    // Report prints only in verbose mode
+    LcdEmu_verbose(1);
+    Lcd_stats_dump();
+#endif
+#ifdef LCD_TRACE
+    // the trace for lcd_replay, Report prints only in verbose mode
+    LcdEmu_verbose(1);
+    Lcd_trace_dump();
+#endif
+    return g_ulViolations ? 1 : 0;
+}
@@ -0,0 +1,33 @@
+//*****************************************************************************
+// i2c_if.h
+//
+// Host build stand-in for the CC3200 SDK common I2C interface. The functions
+// are implemented by the HD44780/PCF8574 emulator in lcd_emu.c
+//
+//*****************************************************************************
+#ifndef __I2C_IF_H__
+#define __I2C_IF_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define I2C_MASTER_MODE_STD     0
+#define I2C_MASTER_MODE_FST     1
+
+int I2C_IF_Open(unsigned long ulMode);
+int I2C_IF_Close();
+int I2C_IF_Write(unsigned char ucDevAddr,
+                 unsigned char *pucData,
+                 unsigned char ucLen,
+                 unsigned char ucStop);
+int I2C_IF_Read(unsigned char ucDevAddr,
+                unsigned char *pucData,
+                unsigned char ucLen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __I2C_IF_H__
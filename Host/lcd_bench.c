@@ -0,0 +1,642 @@
+//*****************************************************************************
+//
+// Application Name     - Lcd i2c benchmark
+// Application Overview - Runs representative workloads of the i2c_lcd library
+//                        against the HD44780/PCF8574T emulator and reports,
+//                        for each one, the I2C transactions, the bytes on the
+//                        wire, the busy-wait time and the bus time at 100kHz
+//                        and 400kHz
+//
+// Usage                - lcd_bench [-o results.json]
+//
+//*****************************************************************************
+#include <stdio.h>
+#include <string.h>
+
+#include "i2c_if.h"
+#include "i2c_lcd.h"
+#include "lcd_emu.h"
+
+//*****************************************************************************
+//                      MACRO DEFINITIONS
+//*****************************************************************************
+#define BENCH_COLS              16
+#define BENCH_ROWS              2
+#define BENCH_DISPLAYS          3   // displays of the multi_ workloads
+#define BENCH_DASH_ADDR         0x20 // 20x4 of the dash_ workloads
+#define BENCH_WIDE_ADDR         0x21 // 40x4, two controllers
+#define BENCH_PASSES            20  // main loop passes of the chatty_ workloads
+#define BENCH_PASS_NS           5000000ULL
+// start + address + acknowledge + stop, and data byte + acknowledge
+#define BITS_PER_TRANSACTION    11
+#define BITS_PER_BYTE           9
+
+//*****************************************************************************
+//                      LOCAL TYPES
+//*****************************************************************************
+typedef struct
+{
+    const char *pcName;
+    unsigned long ulCalls;          // public API calls in one run
+    void (*pfnSetup)(void);
+    void (*pfnRun)(void);
+} tBench;
+
+typedef struct
+{
+    unsigned long ulTransactions;
+    unsigned long ulBytes;
+    unsigned long ulViolations;
+    double dBusyWaitUs;
+    double dBus100kUs;
+    double dBus400kUs;
+    double dWallUs;                 // bus + busy-wait at 100kHz
+} tBenchResult;
+
+//*****************************************************************************
+//                      LOCAL VARIABLES
+//*****************************************************************************
+static unsigned char g_glyphs[12][8] = {
+    {0x0, 0xa, 0x1f, 0x1f, 0xe, 0x4, 0x0, 0x0},
+    {0x2, 0x3, 0x2, 0xe, 0x1e, 0xc, 0x0, 0x0},
+    {0x0, 0xe, 0x15, 0x17, 0x11, 0xe, 0x0, 0x0},
+    {0x0, 0xa, 0x1f, 0x1f, 0xe, 0x4, 0x0, 0x0},
+    {0x0, 0xc, 0x1d, 0xf, 0xf, 0x6, 0x0, 0x0},
+    {0x0, 0x1, 0x3, 0x16, 0x1c, 0x8, 0x0, 0x0},
+    {0x0, 0x1b, 0xe, 0x4, 0xe, 0x1b, 0x0, 0x0},
+    {0x1, 0x1, 0x5, 0x9, 0x1f, 0x8, 0x4, 0x0},
+    {0x4, 0xe, 0xe, 0xe, 0x1f, 0x0, 0x4, 0x0},
+    {0x2, 0x3, 0x2, 0x2, 0xe, 0x1e, 0xc, 0x0},
+    {0x0, 0x4, 0xe, 0x1f, 0x4, 0x4, 0x4, 0x0},
+    {0x0, 0x4, 0x4, 0x4, 0x1f, 0xe, 0x4, 0x0}
+};
+// icons of two screens, the second one shares half of the first one
+static const unsigned char g_screenA[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+static const unsigned char g_screenB[8] = {4, 5, 6, 7, 8, 9, 10, 11};
+
+static tLcd g_displays[BENCH_DISPLAYS];
+static tLcd g_dash;
+static const char g_ticker[] = "Lux 1234  Temp 23.5C  Hum 87%  Wind 3 ";
+static long g_temp;
+static long g_lux;
+static tLcdField g_tempField;
+static tLcdField g_luxField;
+static tLcdWidget g_bar;
+static tLcdWidget g_number;
+static tLcdWindow g_statusWin;
+static tLcdWindow g_contentWin;
+static tLcdWindow g_alarmWin;
+// emulator time as the driver clock, the _clock workloads use it
+static const tLcdClock g_clock = {LcdEmu_micros, LcdEmu_sleep};
+
+//*****************************************************************************
+//                      WORKLOADS
+//*****************************************************************************
+static void
+SetupNone(void)
+{
+}
+
+static void
+SetupInit(void)
+{
+    Lcd_init(BENCH_COLS, BENCH_ROWS);
+    Lcd_backlight(ENABLE);
+    Lcd_displaycontrol(LCD_DISPLAYON,LCD_CURSOROFF,LCD_BLINKOFF);
+}
+
+static void
+SetupRom(void)
+{
+    SetupInit();
+    Lcd_rom(LCD_ROM_A02);
+}
+
+static void
+SetupScreen(void)
+{
+    SetupInit();
+    Lcd_gotoxy(0,0);
+    Lcd_Print("Temp: %2d.%dC", 23, 5);
+    Lcd_gotoxy(0,1);
+    Lcd_Print("Lux: %5lu", 1234UL);
+}
+
+static void
+SetupStatus(void)
+{
+    SetupInit();
+    Lcd_Print("OK");
+}
+
+static void
+SetupStatusHard(void)
+{
+    SetupStatus();
+    Lcd_softclear(DISABLE);
+}
+
+static void
+SetupFramebuffer(void)
+{
+    SetupScreen();
+    Lcd_framebuffer(ENABLE);
+}
+
+static void
+SetupBusyFlag(void)
+{
+    Lcd_busyflag(ENABLE);
+    SetupScreen();
+}
+
+static void
+SetupClock(void)
+{
+    Lcd_clock(&g_clock);
+}
+
+static void
+SetupScreenClock(void)
+{
+    SetupClock();
+    SetupScreen();
+}
+
+static void
+SetupFrames(void)
+{
+    SetupScreenClock();
+    Lcd_refresh_rate(20);
+}
+
+static void
+SetupDisplays(void)
+{
+    unsigned char i;
+    for(i = 0; i < BENCH_DISPLAYS; i++)
+    {
+        Lcd_open(&g_displays[i], LCDI2C_ADDRESS - i);
+        SetupScreen();
+    }
+}
+
+static void
+SetupDash(void)
+{
+    Lcd_open(&g_dash, BENCH_DASH_ADDR);
+    Lcd_init(20, 4);
+    Lcd_backlight(ENABLE);
+    Lcd_framebuffer(ENABLE);
+}
+
+static void
+SetupWide(void)
+{
+    Lcd_open(&g_dash, BENCH_WIDE_ADDR);
+    Lcd_init(40, 4);
+    Lcd_backlight(ENABLE);
+    Lcd_framebuffer(ENABLE);
+}
+
+static void
+SetupDisplaysAsync(void)
+{
+    SetupDisplays();
+    Lcd_async(ENABLE);
+}
+
+static void
+SetupGlyphs(void)
+{
+    SetupInit();
+    Lcd_glyph_table((const unsigned char (*)[8])g_glyphs, 12);
+    Lcd_glyph_load(g_screenA, 8);
+}
+
+static void
+SetupWidgets(void)
+{
+    SetupInit();
+    Lcd_bar_create(&g_bar, LCD_BAR_HORIZONTAL, 0, 0, BENCH_COLS, 0);
+    Lcd_bignum_create(&g_number, 0, 0, 4, 4);
+}
+
+static void
+SetupBar(void)
+{
+    SetupWidgets();
+    Lcd_bar_set(&g_bar, 500, 1000);
+}
+
+static void
+SetupNumber(void)
+{
+    SetupWidgets();
+    Lcd_bignum_set(&g_number, 1234);
+}
+
+static void
+SetupMarquee(void)
+{
+    SetupScreen();
+    Lcd_marquee(0, g_ticker);
+    Lcd_marquee(1, g_ticker);
+}
+
+static void
+SetupMarqueeStatic(void)
+{
+    SetupScreen();
+    Lcd_marquee(0, g_ticker);
+}
+
+static void
+SetupFields(void)
+{
+    SetupScreen();
+    g_temp = 23;
+    g_lux = 1234;
+    Lcd_field_add(&g_tempField, 6, 0, 2, "%2ld", LCD_FIELD_LONG, &g_temp, 0);
+    Lcd_field_add(&g_luxField, 5, 1, 5, "%5ld", LCD_FIELD_LONG, &g_lux, 0);
+    Lcd_service();
+}
+
+static void
+SetupIdle(void)
+{
+    SetupClock();
+    SetupFields();
+    Lcd_backlight_timeout(50);
+}
+
+static void
+SetupVerify(void)
+{
+    SetupFields();
+    Lcd_verify(8);
+}
+
+static void
+RunInit(void)
+{
+    SetupInit();
+}
+
+static void
+RunFullScreen(void)
+{
+    Lcd_gotoxy(0,0);
+    Lcd_Print("CC3200 Lcd I2C  ");
+    Lcd_gotoxy(0,1);
+    Lcd_Print("FC-113 PCF8574T ");
+}
+
+static void
+RunFullScreenUtf8(void)
+{
+    Lcd_gotoxy(0,0);
+    Lcd_Print("Caf\xc3\xa9 23\xc2\xb0" "C     ");
+    Lcd_gotoxy(0,1);
+    Lcd_Print("\xc3\x9c" "berma\xc3\x9f \xce\xb1 \xe2\x86\x92 5   ");
+}
+
+static void
+RunFieldUpdate(void)
+{
+    Lcd_gotoxy(6,0);
+    Lcd_Print("%2d", 24);
+}
+
+static void
+RunFieldFlush(void)
+{
+    Lcd_gotoxy(6,0);
+    Lcd_Print("%2d", 24);
+    Lcd_flush();
+}
+
+static void
+RunCreateChars(void)
+{
+    unsigned char i;
+    for(i = 0; i < 8; i++)
+    {
+        Lcd_createChar(i, g_glyphs[i]);
+    }
+}
+
+static void
+RunGlyphSwap(void)
+{
+    Lcd_glyph_load(g_screenB, 8);
+}
+
+static void
+RunBar(void)
+{
+    Lcd_bar_set(&g_bar, 520, 1000);
+}
+
+static void
+RunNumber(void)
+{
+    Lcd_bignum_set(&g_number, 1235);
+}
+
+static void
+RunFields(void)
+{
+    // one of the two values changed since the last call
+    g_temp = 24;
+    Lcd_service();
+}
+
+static void
+RunIdle(void)
+{
+    unsigned long i;
+    // a 200Hz main loop with nothing new to show
+    for(i = 0; i < BENCH_PASSES; i++)
+    {
+        Lcd_service();
+        LcdEmu_advanceNs(BENCH_PASS_NS);
+    }
+}
+
+static void
+RunVerifyRepair(void)
+{
+    // a cell of row 1 changed by a glitch, found within one screen pass
+    LcdEmu_corrupt(LCDI2C_ADDRESS, 0x42, 'x');
+    RunFields();
+    Lcd_service();
+    Lcd_service();
+    Lcd_service();
+}
+
+static void
+RunVerifyResync(void)
+{
+    // a lost nibble, the next read back resynchronizes
+    LcdEmu_desync(LCDI2C_ADDRESS);
+    Lcd_service();
+}
+
+static void
+RunMarquee(void)
+{
+    Lcd_marquee_step();
+}
+
+static void
+RunClearRedraw(void)
+{
+    Lcd_clear();
+    Lcd_gotoxy(0,0);
+    Lcd_Print("Temp: %2d.%dC", 24, 0);
+    Lcd_gotoxy(0,1);
+    Lcd_Print("Lux: %5lu", 1240UL);
+}
+
+static void
+RunChatty(void)
+{
+    unsigned long i;
+    // a 200Hz main loop rewriting both values on every pass
+    for(i = 0; i < BENCH_PASSES; i++)
+    {
+        Lcd_gotoxy(6,0);
+        Lcd_Print("%2lu", 20 + i / 4);
+        Lcd_gotoxy(5,1);
+        Lcd_Print("%5lu", 1200 + i);
+        Lcd_service();
+        LcdEmu_advanceNs(BENCH_PASS_NS);
+    }
+}
+
+static void
+RunClearStatus(void)
+{
+    Lcd_clear();
+    Lcd_Print("Go");
+    Lcd_home();
+}
+
+static void
+RunAlarmRedraw(void)
+{
+    // the alarm overwrites the screen, dismissing it redraws everything
+    Lcd_gotoxy(0,0);
+    Lcd_Print(" ** ALARM **    ");
+    Lcd_gotoxy(0,1);
+    Lcd_Print("  door open     ");
+    RunClearRedraw();
+}
+
+static void
+SetupWindows(void)
+{
+    SetupInit();
+    Lcd_window_open(&g_statusWin, 0, 0, 16, 1, 0);
+    Lcd_window_open(&g_contentWin, 0, 1, 16, 1, 0);
+    Lcd_window_open(&g_alarmWin, 0, 0, 16, 2, 9);
+    Lcd_window_print(&g_statusWin, "Temp: %2d.%dC", 23, 5);
+    Lcd_window_print(&g_contentWin, "Lux: %5lu", 1234UL);
+    Lcd_window_print(&g_alarmWin, " ** ALARM **\n  door open");
+    Lcd_window_show(&g_alarmWin, DISABLE);
+    Lcd_window_compose();
+    Lcd_flush();
+}
+
+static void
+RunAlarmWindow(void)
+{
+    Lcd_window_show(&g_alarmWin, ENABLE);
+    Lcd_window_compose();
+    Lcd_flush();
+    Lcd_window_show(&g_alarmWin, DISABLE);
+    Lcd_window_compose();
+    Lcd_flush();
+}
+
+static void
+RunDash(void)
+{
+    // every row full, the flush streams them in DDRAM order
+    unsigned char y;
+    for(y = 0; y < 4; y++)
+    {
+        Lcd_gotoxy(0, y);
+        Lcd_Print("Sensor %d %5lu lux .....................", y, 1234UL + y);
+    }
+    Lcd_flush();
+}
+
+static void
+RunDisplays(void)
+{
+    unsigned char i;
+    for(i = 0; i < BENCH_DISPLAYS; i++)
+    {
+        Lcd_select(&g_displays[i]);
+        RunClearRedraw();
+    }
+    // drain the queues, does nothing in synchronous mode
+    while(Lcd_queue_service() > 0)
+    {
+    }
+}
+
+static const tBench g_benches[] = {
+    {"init",            3,  SetupNone,          RunInit},
+    {"init_clock",      3,  SetupClock,         RunInit},
+    {"full_screen",     4,  SetupInit,          RunFullScreen},
+    {"full_screen_utf8",4,  SetupRom,           RunFullScreenUtf8},
+    {"field_update",    2,  SetupScreen,        RunFieldUpdate},
+    {"field_flush",     3,  SetupFramebuffer,   RunFieldFlush},
+    {"field_service",   1,  SetupFields,        RunFields},
+    {"create_chars",    8,  SetupInit,          RunCreateChars},
+    {"glyph_swap",      1,  SetupGlyphs,        RunGlyphSwap},
+    {"bar_update",      1,  SetupBar,           RunBar},
+    {"bignum_update",   1,  SetupNumber,        RunNumber},
+    {"service_idle",    20, SetupFields,        RunIdle},
+    {"backlight_idle",  20, SetupIdle,          RunIdle},
+    {"verify_idle",     20, SetupVerify,        RunIdle},
+    {"verify_repair",   4,  SetupVerify,        RunVerifyRepair},
+    {"verify_resync",   1,  SetupVerify,        RunVerifyResync},
+    {"marquee_step",    1,  SetupMarquee,       RunMarquee},
+    {"marquee_static",  1,  SetupMarqueeStatic, RunMarquee},
+    {"clear_redraw",    5,  SetupScreen,        RunClearRedraw},
+    {"clear_redraw_bf", 5,  SetupBusyFlag,      RunClearRedraw},
+    {"clear_redraw_clk",5,  SetupScreenClock,   RunClearRedraw},
+    {"clear_status",    3,  SetupStatus,        RunClearStatus},
+    {"clear_status_hw", 3,  SetupStatusHard,    RunClearStatus},
+    {"chatty_direct",   100, SetupScreen,       RunChatty},
+    {"chatty_frame",    100, SetupFrames,       RunChatty},
+    {"alarm_redraw",    9,  SetupScreen,        RunAlarmRedraw},
+    {"alarm_window",    6,  SetupWindows,       RunAlarmWindow},
+    {"dash_20x4",       9,  SetupDash,          RunDash},
+    {"dash_40x4",       9,  SetupWide,          RunDash},
+    {"multi_sync",      18, SetupDisplays,      RunDisplays},
+    {"multi_async",     18, SetupDisplaysAsync, RunDisplays},
+};
+
+#define BENCH_COUNT     (sizeof(g_benches) / sizeof(g_benches[0]))
+
+//*****************************************************************************
+//
+//! Run one workload on a freshly powered display
+//!
+//! \param pBench: workload
+//! \param pResult: filled with the counters of the measured part
+//!
+//*****************************************************************************
+static void
+RunBench(const tBench *pBench, tBenchResult *pResult)
+{
+    tLcdEmuStats *pStats = LcdEmu_stats();
+    double dBits;
+
+    LcdEmu_reset(100000);
+    LcdEmu_verbose(0);
+    I2C_IF_Open(I2C_MASTER_MODE_STD);
+    pBench->pfnSetup();
+    LcdEmu_clearStats();
+
+    pBench->pfnRun();
+
+    dBits = (double)pStats->transactions * BITS_PER_TRANSACTION +
+            (double)pStats->bytes * BITS_PER_BYTE;
+    pResult->ulTransactions = pStats->transactions;
+    pResult->ulBytes = pStats->bytes;
+    pResult->ulViolations = pStats->violations;
+    pResult->dBusyWaitUs = pStats->delayNs / 1000.0;
+    pResult->dBus100kUs = dBits * 10.0;
+    pResult->dBus400kUs = dBits * 2.5;
+    pResult->dWallUs = (pStats->busNs + pStats->delayNs) / 1000.0;
+
+    // leave the driver in its default modes for the next workload
+    Lcd_async(DISABLE);
+    Lcd_field_remove(&g_tempField);
+    Lcd_field_remove(&g_luxField);
+    Lcd_marquee(0, NULL);
+    Lcd_marquee(1, NULL);
+    Lcd_window_close(&g_statusWin);
+    Lcd_window_close(&g_contentWin);
+    Lcd_window_close(&g_alarmWin);
+    Lcd_refresh_rate(0);
+    Lcd_backlight_timeout(0);
+    Lcd_verify(0);
+    Lcd_rom(LCD_ROM_RAW);
+    Lcd_framebuffer(DISABLE);
+    Lcd_busyflag(DISABLE);
+    Lcd_softclear(ENABLE);
+    Lcd_clock(NULL);
+    Lcd_select(NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+    tBenchResult results[BENCH_COUNT];
+    FILE *pOut = NULL;
+    unsigned int i;
+    int iRet = 0;
+
+    if(argc == 3 && strcmp(argv[1], "-o") == 0)
+    {
+        pOut = fopen(argv[2], "w");
+        if(pOut == NULL)
+        {
+            perror(argv[2]);
+            return 2;
+        }
+    }
+
+    for(i = 0; i < BENCH_DISPLAYS; i++)
+    {
+        LcdEmu_attach(LCDI2C_ADDRESS - i, BENCH_COLS, BENCH_ROWS);
+    }
+    LcdEmu_attach(BENCH_DASH_ADDR, 20, 4);
+    LcdEmu_attach(BENCH_WIDE_ADDR, 40, 4);
+
+    printf("%-16s %6s %6s %7s %10s %10s %10s %10s %5s\n", "workload",
+           "calls", "trans", "bytes", "wait_us", "bus100k_us", "bus400k_us",
+           "wall_us", "viol");
+    for(i = 0; i < BENCH_COUNT; i++)
+    {
+        tBenchResult *pRes = &results[i];
+        RunBench(&g_benches[i], pRes);
+        printf("%-16s %6lu %6lu %7lu %10.0f %10.0f %10.0f %10.0f %5lu\n",
+               g_benches[i].pcName, g_benches[i].ulCalls, pRes->ulTransactions,
+               pRes->ulBytes, pRes->dBusyWaitUs, pRes->dBus100kUs,
+               pRes->dBus400kUs, pRes->dWallUs, pRes->ulViolations);
+        if(pRes->ulViolations)
+        {
+            iRet = 1;
+        }
+    }
+
+    if(pOut != NULL)
+    {
+        fprintf(pOut, "[\n");
+        for(i = 0; i < BENCH_COUNT; i++)
+        {
+            tBenchResult *pRes = &results[i];
+            fprintf(pOut, "  {\"workload\": \"%s\", \"calls\": %lu, "
+                    "\"transactions\": %lu, \"bytes\": %lu, "
+                    "\"busy_wait_us\": %.1f, \"bus_100k_us\": %.1f, "
+                    "\"bus_400k_us\": %.1f, \"wall_us\": %.1f, "
+                    "\"violations\": %lu}%s\n",
+                    g_benches[i].pcName, g_benches[i].ulCalls,
+                    pRes->ulTransactions, pRes->ulBytes, pRes->dBusyWaitUs,
+                    pRes->dBus100kUs, pRes->dBus400kUs, pRes->dWallUs,
+                    pRes->ulViolations, (i + 1 < BENCH_COUNT) ? "," : "");
+        }
+        fprintf(pOut, "]\n");
+        fclose(pOut);
+    }
+
+    return iRet;
+}
@@ -0,0 +1,641 @@
+/*
+ * lcd_emu.c
+ *
+ *  Host side HD44780 + PCF8574T emulator
+ *
+ *      See lcd_emu.h for the model. Timings come from the HD44780U datasheet
+ *      (fosc = 270kHz): 1.52ms for clear/home, 37us for every other
+ *      instruction, 37us + 4us for data writes and the initialization waits
+ *      of page 45/46 (40ms, 4.1ms, 100us).
+ *
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "i2c_if.h"
+#include "rom_map.h"
+#include "uart_if.h"
+#include "lcd_emu.h"
+
+//*****************************************************************************
+//                      MACRO DEFINITIONS
+//*****************************************************************************
+#define PIN_RS		0x01
+#define PIN_RW		0x02
+#define PIN_E		0x04
+#define PIN_LED		0x08
+
+#define NS_POWERUP		40000000ULL
+#define NS_INIT_FIRST	4100000ULL
+#define NS_INIT_SECOND	100000ULL
+#define NS_LONG_CMD		1520000ULL
+#define NS_CMD			37000ULL
+#define NS_DATA			41000ULL
+
+#define DDRAM_LINE		40
+
+//*****************************************************************************
+//                      LOCAL TYPES
+//*****************************************************************************
+typedef struct
+{
+	int present;
+	unsigned char addr;
+	unsigned char cols;
+	unsigned char rows;
+	int dual;					// one of the two controllers of a 40x4 module
+	int lower;					// the controller of rows 2 and 3, E on RW
+	unsigned char pinE;			// expander pin of E
+	unsigned char pinRW;		// expander pin of RW, 0 when tied low
+	unsigned char pins;			// last state written to the expander
+	unsigned char drive;		// D7..D4 driven by the controller on reads
+	unsigned char riseCtl;		// RS/RW sampled on the E rising edge
+	int fourBit;
+	int lowNibble;				// next nibble is the low one
+	unsigned char highNibble;
+	int initWrites;				// 8-bit function sets seen since power up
+	int twoLine;
+	unsigned char ddram[2 * DDRAM_LINE];
+	unsigned char cgram[64];
+	unsigned char ac;
+	int cgMode;
+	int increment;
+	int shiftOnWrite;
+	int displayOn;
+	int cursorOn;
+	int blinkOn;
+	int shift;
+	unsigned long long busyUntil;
+	unsigned long long poweredAt;
+} tPanel;
+
+//*****************************************************************************
+//                      LOCAL VARIABLES
+//*****************************************************************************
+static tPanel g_panels[LCDEMU_MAX_PANELS];
+static tLcdEmuStats g_stats;
+static unsigned long long g_now = 0;
+static unsigned long g_bitNs = 10000;
+static int g_verbose = 1;
+static void (*g_tap)(unsigned char addr, const unsigned char *data,
+		unsigned char len) = NULL;
+
+//****************************************************************************
+//                      LOCAL FUNCTION DEFINITIONS
+//****************************************************************************
+static tPanel *FindPart(unsigned char addr, int lower)
+{
+	int i;
+	for (i = 0; i < LCDEMU_MAX_PANELS; i++)
+	{
+		if (g_panels[i].present && g_panels[i].addr == addr
+				&& g_panels[i].lower == lower)
+			return &g_panels[i];
+	}
+	return NULL;
+}
+
+static tPanel *FindPanel(unsigned char addr)
+{
+	return FindPart(addr, 0);
+}
+
+static void Violation(tPanel *p, const char *fmt, ...)
+{
+	va_list list;
+	g_stats.violations++;
+	if (!g_verbose)
+		return;
+	fprintf(stderr, "[lcd_emu 0x%02x @%llu.%03llums] ", p->addr,
+			g_now / 1000000ULL, (g_now / 1000ULL) % 1000ULL);
+	va_start(list, fmt);
+	vfprintf(stderr, fmt, list);
+	va_end(list);
+	fputc('\n', stderr);
+}
+
+static int DdramIndex(tPanel *p, unsigned char ac)
+{
+	if (p->twoLine)
+		return ((ac & 0x40) ? DDRAM_LINE : 0) + ((ac & 0x3F) % DDRAM_LINE);
+	return (ac & 0x7F) % (2 * DDRAM_LINE);
+}
+
+static unsigned char DdramStep(tPanel *p, unsigned char ac, int up)
+{
+	if (p->twoLine)
+	{
+		unsigned char pos = ac & 0x3F, line = ac & 0x40;
+		if (pos >= DDRAM_LINE)
+			pos = 0;
+		if (up)
+		{
+			if (++pos == DDRAM_LINE)
+			{
+				pos = 0;
+				line ^= 0x40;
+			}
+		}
+		else
+		{
+			if (pos-- == 0)
+			{
+				pos = DDRAM_LINE - 1;
+				line ^= 0x40;
+			}
+		}
+		return line | pos;
+	}
+	if (up)
+		return (ac + 1) % (2 * DDRAM_LINE);
+	return ac == 0 ? 2 * DDRAM_LINE - 1 : ac - 1;
+}
+
+static void MoveAc(tPanel *p, int up)
+{
+	if (p->cgMode)
+		p->ac = (p->ac + (up ? 1 : 63)) & 0x3F;
+	else
+		p->ac = DdramStep(p, p->ac, up);
+}
+
+static void Execute(tPanel *p, unsigned char value, int rs)
+{
+	unsigned long long busy = NS_CMD;
+
+	if (g_now < p->busyUntil)
+		Violation(p, "%s 0x%02x sent %lluns before the controller was ready",
+				rs ? "data" : "instruction", value, p->busyUntil - g_now);
+
+	if (rs)
+	{
+		g_stats.dataWrites++;
+		if (p->cgMode)
+			p->cgram[p->ac & 0x3F] = value;
+		else
+			p->ddram[DdramIndex(p, p->ac)] = value;
+		MoveAc(p, p->increment);
+		if (p->shiftOnWrite && !p->cgMode)
+			p->shift += p->increment ? 1 : -1;
+		p->busyUntil = g_now + NS_DATA;
+		return;
+	}
+
+	g_stats.instructions++;
+	if (value & 0x80)
+	{
+		p->ac = value & 0x7F;
+		p->cgMode = 0;
+	}
+	else if (value & 0x40)
+	{
+		p->ac = value & 0x3F;
+		p->cgMode = 1;
+	}
+	else if (value & 0x20)
+	{
+		if (!p->fourBit && p->initWrites < 3 && (value & 0x10))
+		{
+			if (p->initWrites == 0)
+				busy = NS_INIT_FIRST;
+			else if (p->initWrites == 1)
+				busy = NS_INIT_SECOND;
+			p->initWrites++;
+		}
+		p->fourBit = !(value & 0x10);
+		if (!p->fourBit)
+			p->lowNibble = 0;
+		p->twoLine = (value & 0x08) != 0;
+	}
+	else if (value & 0x10)
+	{
+		int up = (value & 0x04) != 0;
+		if (value & 0x08)
+			p->shift += up ? -1 : 1;
+		else
+			MoveAc(p, up);
+	}
+	else if (value & 0x08)
+	{
+		p->displayOn = (value & 0x04) != 0;
+		p->cursorOn = (value & 0x02) != 0;
+		p->blinkOn = (value & 0x01) != 0;
+	}
+	else if (value & 0x04)
+	{
+		p->increment = (value & 0x02) != 0;
+		p->shiftOnWrite = (value & 0x01) != 0;
+	}
+	else if (value & 0x02)
+	{
+		p->ac = 0;
+		p->cgMode = 0;
+		p->shift = 0;
+		busy = NS_LONG_CMD;
+	}
+	else if (value & 0x01)
+	{
+		memset(p->ddram, ' ', sizeof(p->ddram));
+		p->ac = 0;
+		p->cgMode = 0;
+		p->shift = 0;
+		p->increment = 1;
+		busy = NS_LONG_CMD;
+	}
+	p->busyUntil = g_now + busy;
+}
+
+static void Nibble(tPanel *p, unsigned char nibble, int rs)
+{
+	if (g_now - p->poweredAt < NS_POWERUP)
+		Violation(p, "write %lluns before the 40ms power up time",
+				NS_POWERUP - (g_now - p->poweredAt));
+	if (!p->fourBit)
+	{
+		// DB3..DB0 are not wired, they read as 0
+		Execute(p, nibble << 4, rs);
+		return;
+	}
+	if (!p->lowNibble)
+	{
+		p->highNibble = nibble;
+		p->lowNibble = 1;
+		return;
+	}
+	p->lowNibble = 0;
+	Execute(p, (p->highNibble << 4) | nibble, rs);
+}
+
+static void ReadDrive(tPanel *p)
+{
+	unsigned char value;
+	if (p->riseCtl & PIN_RS)
+		value = p->cgMode ? p->cgram[p->ac & 0x3F] : p->ddram[DdramIndex(p, p->ac)];
+	else
+		value = (g_now < p->busyUntil ? 0x80 : 0x00) | (p->ac & 0x7F);
+	if (!p->fourBit || !p->lowNibble)
+		p->drive = value & 0xF0;
+	else
+		p->drive = (value << 4) & 0xF0;
+}
+
+static void ReadDone(tPanel *p)
+{
+	if (p->fourBit)
+	{
+		p->lowNibble = !p->lowNibble;
+		if (p->lowNibble)
+			return;
+	}
+	if (p->riseCtl & PIN_RS)
+	{
+		if (g_now < p->busyUntil)
+			Violation(p, "data read while busy");
+		MoveAc(p, p->increment);
+		p->busyUntil = g_now + NS_DATA;
+	}
+}
+
+static void Pins(tPanel *p, unsigned char value)
+{
+	unsigned char prev = p->pins;
+	p->pins = value;
+
+	if (!(prev & p->pinE) && (value & p->pinE))
+	{
+		if ((prev ^ value) & (PIN_RS | p->pinRW))
+			Violation(p, "RS/RW changed together with the E rising edge");
+		p->riseCtl = (value & PIN_RS) | ((value & p->pinRW) ? PIN_RW : 0);
+		if (p->riseCtl & PIN_RW)
+			ReadDrive(p);
+	}
+	else if ((prev & p->pinE) && !(value & p->pinE))
+	{
+		if (p->riseCtl & PIN_RW)
+			ReadDone(p);
+		else
+			Nibble(p, prev >> 4, p->riseCtl & PIN_RS);
+	}
+}
+
+static void PowerOn(tPanel *p)
+{
+	unsigned char addr = p->addr, cols = p->cols, rows = p->rows;
+	int dual = p->dual, lower = p->lower;
+	memset(p, 0, sizeof(*p));
+	p->present = 1;
+	p->addr = addr;
+	p->cols = cols;
+	p->rows = rows;
+	p->dual = dual;
+	p->lower = lower;
+	// a 40x4 module wires the E of the second controller to P1, RW is low
+	p->pinE = lower ? PIN_RW : PIN_E;
+	p->pinRW = dual ? 0 : PIN_RW;
+	p->pins = 0xFF;
+	p->increment = 1;
+	p->poweredAt = g_now;
+	memset(p->ddram, ' ', sizeof(p->ddram));
+}
+
+//****************************************************************************
+//                      SDK INTERFACE
+//****************************************************************************
+int I2C_IF_Open(unsigned long ulMode)
+{
+	g_bitNs = (ulMode == I2C_MASTER_MODE_FST) ? 2500 : 10000;
+	return 0;
+}
+
+int I2C_IF_Close()
+{
+	return 0;
+}
+
+int I2C_IF_Write(unsigned char ucDevAddr, unsigned char *pucData,
+		unsigned char ucLen, unsigned char ucStop)
+{
+	tPanel *p = FindPanel(ucDevAddr);
+	tPanel *pLower = FindPart(ucDevAddr, 1);
+	unsigned char i;
+
+	g_stats.transactions++;
+	// start condition + address byte with its acknowledge
+	g_now += 10ULL * g_bitNs;
+	g_stats.busNs += 10ULL * g_bitNs;
+	if (p == NULL)
+	{
+		g_stats.nacks++;
+		return -1;
+	}
+	if (g_tap != NULL)
+		g_tap(ucDevAddr, pucData, ucLen);
+	for (i = 0; i < ucLen; i++)
+	{
+		g_now += 9ULL * g_bitNs;
+		g_stats.busNs += 9ULL * g_bitNs;
+		g_stats.bytes++;
+		Pins(p, pucData[i]);
+		if (pLower != NULL)
+			Pins(pLower, pucData[i]);
+	}
+	if (ucStop)
+	{
+		g_now += g_bitNs;
+		g_stats.busNs += g_bitNs;
+	}
+	return 0;
+}
+
+int I2C_IF_Read(unsigned char ucDevAddr, unsigned char *pucData,
+		unsigned char ucLen)
+{
+	tPanel *p = FindPanel(ucDevAddr);
+	unsigned char i;
+
+	g_stats.transactions++;
+	g_stats.reads++;
+	g_now += 10ULL * g_bitNs;
+	g_stats.busNs += 10ULL * g_bitNs;
+	if (p == NULL)
+	{
+		g_stats.nacks++;
+		return -1;
+	}
+	for (i = 0; i < ucLen; i++)
+	{
+		unsigned char value = p->pins;
+		g_now += 9ULL * g_bitNs;
+		g_stats.busNs += 9ULL * g_bitNs;
+		g_stats.bytes++;
+		// quasi-bidirectional pins: the controller can only pull them low
+		if ((p->pins & p->pinE) && (p->pins & p->pinRW))
+			value &= p->drive | 0x0F;
+		pucData[i] = value;
+	}
+	g_now += g_bitNs;
+	g_stats.busNs += g_bitNs;
+	return 0;
+}
+
+void MAP_UtilsDelay(unsigned long ulCount)
+{
+	// 3 cycles per loop on the ROM, 5 as assumed by i2c_lcd.c, at 80MHz
+	unsigned long long ns = (unsigned long long)ulCount * 5ULL * 25ULL / 2ULL;
+	g_now += ns;
+	g_stats.delayNs += ns;
+}
+
+void Message(const char *str)
+{
+	if (g_verbose)
+		fputs(str, stdout);
+}
+
+int Report(const char *format, ...)
+{
+	int ret = 0;
+	va_list list;
+	if (g_verbose)
+	{
+		va_start(list, format);
+		ret = vprintf(format, list);
+		va_end(list);
+	}
+	return ret;
+}
+
+//****************************************************************************
+//                      EMULATOR API
+//****************************************************************************
+void LcdEmu_reset(unsigned long busHz)
+{
+	int i;
+	g_bitNs = busHz ? 1000000000UL / busHz : 10000;
+	memset(&g_stats, 0, sizeof(g_stats));
+	for (i = 0; i < LCDEMU_MAX_PANELS; i++)
+	{
+		if (g_panels[i].present)
+			PowerOn(&g_panels[i]);
+	}
+}
+
+static void Attach(unsigned char addr, unsigned char cols, unsigned char rows,
+		int dual, int lower)
+{
+	tPanel *p = FindPart(addr, lower);
+	int i;
+	for (i = 0; p == NULL && i < LCDEMU_MAX_PANELS; i++)
+	{
+		if (!g_panels[i].present)
+			p = &g_panels[i];
+	}
+	if (p == NULL)
+		return;
+	p->addr = addr;
+	p->cols = cols;
+	p->rows = rows;
+	p->dual = dual;
+	p->lower = lower;
+	PowerOn(p);
+}
+
+void LcdEmu_attach(unsigned char addr, unsigned char cols, unsigned char rows)
+{
+	tPanel *p = FindPart(addr, 1);
+	int dual;
+	cols = cols > LCDEMU_MAX_COLS ? LCDEMU_MAX_COLS : cols;
+	rows = rows > LCDEMU_MAX_ROWS ? LCDEMU_MAX_ROWS : rows;
+	// more than the 80 characters of one HD44780, two controllers
+	dual = cols * rows > 2 * DDRAM_LINE;
+	if (p != NULL && !dual)
+		p->present = 0;
+	Attach(addr, cols, rows, dual, 0);
+	if (dual)
+		Attach(addr, cols, rows, dual, 1);
+}
+
+void LcdEmu_verbose(int enable)
+{
+	g_verbose = enable;
+}
+
+void LcdEmu_tap(void (*pfnTap)(unsigned char addr, const unsigned char *data,
+		unsigned char len))
+{
+	g_tap = pfnTap;
+}
+
+void LcdEmu_clearStats()
+{
+	memset(&g_stats, 0, sizeof(g_stats));
+}
+
+tLcdEmuStats *LcdEmu_stats()
+{
+	return &g_stats;
+}
+
+unsigned long long LcdEmu_nowNs()
+{
+	return g_now;
+}
+
+void LcdEmu_advanceNs(unsigned long long ns)
+{
+	g_now += ns;
+}
+
+unsigned long LcdEmu_micros()
+{
+	return (unsigned long)(g_now / 1000ULL);
+}
+
+void LcdEmu_sleep(unsigned long ulMicros)
+{
+	g_now += ulMicros * 1000ULL;
+	g_stats.delayNs += ulMicros * 1000ULL;
+}
+
+int LcdEmu_row(unsigned char addr, unsigned char row, char *buf)
+{
+	tPanel *p = FindPanel(addr);
+	int c, line, offset;
+	if (p == NULL || row >= p->rows)
+		return -1;
+	line = row & 1;
+	offset = (row & 2) ? p->cols : 0;
+	if (p->dual)
+	{
+		// rows 2 and 3 are the two lines of the second controller
+		p = FindPart(addr, (row & 2) != 0);
+		offset = 0;
+	}
+	for (c = 0; c < p->cols; c++)
+	{
+		int pos;
+		if (p->twoLine)
+		{
+			pos = (offset + c + p->shift) % DDRAM_LINE;
+			if (pos < 0)
+				pos += DDRAM_LINE;
+			buf[c] = p->ddram[line * DDRAM_LINE + pos];
+		}
+		else
+		{
+			pos = (row * p->cols + c + p->shift) % (2 * DDRAM_LINE);
+			if (pos < 0)
+				pos += 2 * DDRAM_LINE;
+			buf[c] = p->ddram[pos];
+		}
+	}
+	buf[c] = '\0';
+	return c;
+}
+
+void LcdEmu_render(unsigned char addr, FILE *out)
+{
+	tPanel *p = FindPanel(addr);
+	char row[LCDEMU_MAX_COLS + 1];
+	int r, c;
+	if (p == NULL)
+		return;
+	fputc('+', out);
+	for (c = 0; c < p->cols; c++)
+		fputc('-', out);
+	fputs("+\n", out);
+	for (r = 0; r < p->rows; r++)
+	{
+		LcdEmu_row(addr, r, row);
+		fputc('|', out);
+		for (c = 0; c < p->cols; c++)
+		{
+			unsigned char ch = (unsigned char)row[c];
+			if (!p->displayOn)
+				ch = ' ';
+			else if (ch < 0x10)
+				ch = '0' + (ch & 7);	// CGRAM glyph, 0x08-0x0F repeat 0-7
+			else if (ch < 0x20 || ch > 0x7E)
+				ch = '?';
+			fputc(ch, out);
+		}
+		fputs("|\n", out);
+	}
+	fputc('+', out);
+	for (c = 0; c < p->cols; c++)
+		fputc('-', out);
+	fprintf(out, "+ %s\n", (p->pins & PIN_LED) ? "backlight" : "dark");
+}
+
+const unsigned char *LcdEmu_cgram(unsigned char addr)
+{
+	tPanel *p = FindPanel(addr);
+	return p ? p->cgram : NULL;
+}
+
+unsigned char LcdEmu_backlight(unsigned char addr)
+{
+	tPanel *p = FindPanel(addr);
+	return p ? (p->pins & PIN_LED) != 0 : 0;
+}
+
+unsigned char LcdEmu_cursor(unsigned char addr)
+{
+	tPanel *p = FindPanel(addr);
+	return p ? p->ac : 0;
+}
+
+void LcdEmu_desync(unsigned char addr)
+{
+	tPanel *p = FindPanel(addr);
+	if (p != NULL && p->fourBit)
+		p->lowNibble = !p->lowNibble;
+}
+
+void LcdEmu_corrupt(unsigned char addr, unsigned char ddramAddr, unsigned char value)
+{
+	tPanel *p = FindPanel(addr);
+	if (p != NULL)
+		p->ddram[DdramIndex(p, ddramAddr)] = value;
+}
@@ -0,0 +1,89 @@
+/*
+ * lcd_emu.h
+ *
+ *  Host side HD44780 + PCF8574T emulator
+ *
+ *      Implements I2C_IF_Write, I2C_IF_Read and MAP_UtilsDelay on a virtual
+ *      clock so the lcd library can be built and checked on a PC.
+ *
+ *      Every byte written to an attached expander address drives the pins
+ *      documented in i2c_lcd.h:
+ *
+ *      7 | 6 | 5 | 4 |  3  | 2 | 1  | 0  |
+ *      D7| D6| D5| D4| LED | E | RW | RS |
+ *
+ *      The falling edge of E latches D7..D4 into the controller, which models
+ *      the power-up 8-bit interface, the switch to 4-bit mode, DDRAM, CGRAM,
+ *      the address counter, entry mode, display shift and the execution time
+ *      of every instruction. Instructions sent while the controller is busy
+ *      are reported as timing violations.
+ *
+ *      A module of more than 80 characters (40x4) has two controllers, rows
+ *      0-1 and rows 2-3, the second one latches on P1 as a 40x4 backpack
+ *      wires it, and both have RW tied low.
+ *
+ */
+
+#ifndef LCD_EMU_H_
+#define LCD_EMU_H_
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+//*****************************************************************************
+// Emulator limits
+//*****************************************************************************
+#define LCDEMU_MAX_PANELS	8
+#define LCDEMU_MAX_COLS		40
+#define LCDEMU_MAX_ROWS		4
+
+//*****************************************************************************
+// Bus and timing counters
+//*****************************************************************************
+typedef struct
+{
+	unsigned long transactions;		// I2C start/address/stop sequences
+	unsigned long bytes;			// data bytes, address excluded
+	unsigned long reads;			// read transactions
+	unsigned long nacks;			// transactions to an absent address
+	unsigned long instructions;		// instructions executed (RS = 0)
+	unsigned long dataWrites;		// DDRAM/CGRAM writes (RS = 1)
+	unsigned long violations;		// busy or setup time violations
+	unsigned long long busNs;		// time the bus was occupied
+	unsigned long long delayNs;		// time spent in MAP_UtilsDelay
+} tLcdEmuStats;
+
+//*****************************************************************************
+//
+// API Function prototypes
+//
+//*****************************************************************************
+	void LcdEmu_reset(unsigned long busHz);
+	void LcdEmu_attach(unsigned char addr, unsigned char cols, unsigned char rows);
+	void LcdEmu_verbose(int enable);
+	// called with the bytes of every write acknowledged by an expander
+	void LcdEmu_tap(void (*pfnTap)(unsigned char addr, const unsigned char *data,
+			unsigned char len));
+	void LcdEmu_clearStats();
+	tLcdEmuStats *LcdEmu_stats();
+	unsigned long long LcdEmu_nowNs();
+	void LcdEmu_advanceNs(unsigned long long ns);
+	unsigned long LcdEmu_micros();
+	void LcdEmu_sleep(unsigned long ulMicros);
+	int  LcdEmu_row(unsigned char addr, unsigned char row, char *buf);
+	void LcdEmu_render(unsigned char addr, FILE *out);
+	const unsigned char *LcdEmu_cgram(unsigned char addr);
+	unsigned char LcdEmu_backlight(unsigned char addr);
+	unsigned char LcdEmu_cursor(unsigned char addr);
+	void LcdEmu_desync(unsigned char addr);
+	void LcdEmu_corrupt(unsigned char addr, unsigned char ddramAddr, unsigned char value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LCD_EMU_H_
@@ -0,0 +1,339 @@
+//*****************************************************************************
+//
+// Application Name     - Lcd i2c encoder check
+// Application Overview - Checks the _encode table writes against the per
+//                        nibble encoder it replaced: every byte and command
+//                        nibble, then a random workload of bytes, commands,
+//                        messages, bursts and backlight changes. The expander
+//                        states on the bus are decoded into the nibbles the
+//                        HD44780 latches on the falling edge of E, which must
+//                        be the same, with RS and RW settled before E rises
+//                        and held until it falls
+//
+// Usage                - lcd_encode_check [random steps [seed]]
+//
+//*****************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2c_if.h"
+#include "i2c_lcd.h"
+#include "lcd_emu.h"
+
+//*****************************************************************************
+//                      MACRO DEFINITIONS
+//*****************************************************************************
+#define CHECK_COLS              20
+#define CHECK_ROWS              4
+#define CHECK_STEPS             20000   // default random steps
+#define CHECK_LATCHES           4096    // nibbles compared at once
+#define CHECK_LATCH_MASK        (0xF0 | LCD_BACKLIGHT | Rs)
+
+//*****************************************************************************
+//                      LOCAL TYPES
+//*****************************************************************************
+typedef struct
+{
+    unsigned char ucLast;           // last expander state
+    unsigned int uiLatches;
+    unsigned char aucLatch[CHECK_LATCHES]; // D7..D4, backlight and RS
+    unsigned long ulBytes;
+    unsigned long ulErrors;         // RS or RW changed around E high
+} tWire;
+
+//*****************************************************************************
+//                      LOCAL VARIABLES
+//*****************************************************************************
+static tWire g_driver;              // written by the library
+static tWire g_reference;           // written by the old encoder
+static unsigned char g_ucBacklight = 0;
+static unsigned long g_ulMismatches = 0;
+static unsigned long g_ulNibbles = 0;
+
+//*****************************************************************************
+//
+//! Decode expander states into latched nibbles
+//!
+//! \param pWire: wire the states were written on
+//! \param pucData: expander states
+//! \param ulLen: number of states
+//!
+//*****************************************************************************
+static void
+Decode(tWire *pWire, const unsigned char *pucData, unsigned long ulLen)
+{
+    unsigned char ucPrev;
+    unsigned long i;
+
+    for(i = 0; i < ulLen; i++)
+    {
+        ucPrev = pWire->ucLast;
+        if(!(ucPrev & En) && (pucData[i] & En)
+           && (ucPrev & (Rs | Rw)) != (pucData[i] & (Rs | Rw)))
+        {
+            // RS and RW need their setup time before E rises
+            pWire->ulErrors++;
+        }
+        if((ucPrev & En) && !(pucData[i] & En))
+        {
+            // the data and RS are held past the falling edge
+            if((ucPrev & (0xF0 | Rs | Rw)) != (pucData[i] & (0xF0 | Rs | Rw)))
+            {
+                pWire->ulErrors++;
+            }
+            if(pWire->uiLatches < CHECK_LATCHES)
+            {
+                pWire->aucLatch[pWire->uiLatches++] = ucPrev & CHECK_LATCH_MASK;
+            }
+        }
+        pWire->ucLast = pucData[i];
+    }
+    pWire->ulBytes += ulLen;
+}
+
+//*****************************************************************************
+//
+//! Emulator bus tap, decodes what the library writes
+//
+//*****************************************************************************
+static void
+Tap(unsigned char addr, const unsigned char *data, unsigned char len)
+{
+    (void)addr;
+    Decode(&g_driver, data, len);
+}
+
+//*****************************************************************************
+//
+//! Old Lcd_send_byte: four states per nibble, high nibble first
+//!
+//! \param value: byte to send
+//! \param mode: COMMAND or DATA
+//!
+//*****************************************************************************
+static void
+OldSendByte(unsigned char value, unsigned char mode)
+{
+    unsigned char expand[2];
+    unsigned char states[8];
+    int i, n = 0;
+
+    expand[1] = value & 0xF0;
+    expand[0] = (value & 0x0F) << 4;
+    for(i = 2; i > 0; i--)
+    {
+        states[n++] = ((expand[i-1] & ~Rw) | mode) | g_ucBacklight;
+        states[n++] = ((expand[i-1] & ~Rw) | En | mode) | g_ucBacklight;
+        states[n++] = ((expand[i-1] & ~Rw & ~En) | mode) | g_ucBacklight;
+        states[n++] = ((expand[i-1] & Rw & ~En) | mode) | g_ucBacklight;
+    }
+    Decode(&g_reference, states, n);
+}
+
+//*****************************************************************************
+//
+//! Old Lcd_send_command: the low nibble only, as in the reset sequence
+//!
+//! \param value: nibble to send
+//!
+//*****************************************************************************
+static void
+OldSendCommand(unsigned char value)
+{
+    unsigned char expand = (value & 0x0F) << 4;
+    unsigned char states[4];
+
+    states[0] = (expand & ~Rw) | g_ucBacklight;
+    states[1] = (expand & ~Rw) | En | g_ucBacklight;
+    states[2] = (expand & ~Rw & ~En) | g_ucBacklight;
+    states[3] = (expand & Rw & ~En) | g_ucBacklight;
+    Decode(&g_reference, states, 4);
+}
+
+//*****************************************************************************
+//
+//! Compare the nibbles latched since the last call
+//!
+//! \param pcStep: name of the step, printed on a mismatch
+//!
+//*****************************************************************************
+static void
+Compare(const char *pcStep)
+{
+    if(g_driver.uiLatches != g_reference.uiLatches
+       || memcmp(g_driver.aucLatch, g_reference.aucLatch,
+                 g_driver.uiLatches) != 0)
+    {
+        if(g_ulMismatches++ < 10)
+        {
+            printf("%s: %u nibbles latched, %u expected\n", pcStep,
+                   g_driver.uiLatches, g_reference.uiLatches);
+        }
+    }
+    g_ulNibbles += g_reference.uiLatches;
+    g_driver.uiLatches = 0;
+    g_reference.uiLatches = 0;
+}
+
+//*****************************************************************************
+//
+//! A command that leaves the 4-bit interface and the geometry alone
+//!
+//*****************************************************************************
+static unsigned char
+RandomCommand(void)
+{
+    switch(rand() % 5)
+    {
+    case 0:
+        return LCD_SETDDRAMADDR | (rand() & 0x7F);
+    case 1:
+        return LCD_SETCGRAMADDR | (rand() & 0x3F);
+    case 2:
+        return LCD_ENTRYMODESET | (rand() & 0x03);
+    case 3:
+        return LCD_CURSORSHIFT | (rand() & 0x0C);
+    default:
+        return LCD_DISPLAYCONTROL | 0x04 | (rand() & 0x03);
+    }
+}
+
+//*****************************************************************************
+//
+//! One random step, sent through the library and the old encoder
+//!
+//*****************************************************************************
+static void
+RandomStep(void)
+{
+    char acText[CHECK_COLS + 1];
+    unsigned char ucValue;
+    int i, n;
+
+    switch(rand() % 5)
+    {
+    case 0:
+        ucValue = rand() & 0xFF;
+        Lcd_send_byte(ucValue, DATA);
+        OldSendByte(ucValue, DATA);
+        break;
+    case 1:
+        ucValue = RandomCommand();
+        Lcd_send_byte(ucValue, COMMAND);
+        OldSendByte(ucValue, COMMAND);
+        break;
+    case 2:
+        // the multi-character path of Lcd_message
+        n = rand() % CHECK_COLS + 1;
+        for(i = 0; i < n; i++)
+        {
+            acText[i] = (char)(rand() % 255 + 1);
+        }
+        acText[n] = '\0';
+        Lcd_message(acText);
+        for(i = 0; i < n; i++)
+        {
+            OldSendByte((unsigned char)acText[i], DATA);
+        }
+        break;
+    case 3:
+        // several writes in one burst, the RS setup state crosses them
+        Lcd_burst_begin();
+        n = rand() % 8 + 1;
+        for(i = 0; i < n; i++)
+        {
+            ucValue = (rand() & 1) ? RandomCommand() : (rand() & 0xFF);
+            if(ucValue & 1)
+            {
+                Lcd_send_byte(ucValue, DATA);
+                OldSendByte(ucValue, DATA);
+            }
+            else
+            {
+                Lcd_send_byte(ucValue, COMMAND);
+                OldSendByte(ucValue, COMMAND);
+            }
+        }
+        Lcd_burst_end();
+        break;
+    default:
+        // no E pulse, the next writes carry the new backlight
+        ucValue = rand() & 1;
+        Lcd_backlight(ucValue ? ENABLE : DISABLE);
+        g_ucBacklight = ucValue ? LCD_BACKLIGHT : 0;
+        break;
+    }
+    Compare("random");
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned long ulSteps = CHECK_STEPS;
+    unsigned long i;
+    unsigned int uiValue;
+    unsigned char ucMode;
+    char acStep[32];
+
+    if(argc > 1)
+    {
+        ulSteps = strtoul(argv[1], NULL, 0);
+    }
+    srand(argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 0) : 1);
+
+    LcdEmu_attach(LCDI2C_ADDRESS, CHECK_COLS, CHECK_ROWS);
+    LcdEmu_reset(100000);
+    LcdEmu_verbose(0);
+    I2C_IF_Open(I2C_MASTER_MODE_STD);
+    Lcd_init(CHECK_COLS, CHECK_ROWS);
+    Lcd_backlight(ENABLE);
+    g_ucBacklight = LCD_BACKLIGHT;
+    LcdEmu_tap(Tap);
+
+    // every entry of the table, in both modes
+    for(ucMode = COMMAND; ucMode <= DATA; ucMode++)
+    {
+        for(uiValue = 0; uiValue < 256; uiValue++)
+        {
+            Lcd_send_byte(uiValue, ucMode);
+            OldSendByte(uiValue, ucMode);
+            snprintf(acStep, sizeof(acStep), "%s 0x%02x",
+                     ucMode == DATA ? "data" : "command", uiValue);
+            Compare(acStep);
+        }
+    }
+    for(uiValue = 0; uiValue < 16; uiValue++)
+    {
+        Lcd_send_command(uiValue);
+        OldSendCommand(uiValue);
+        snprintf(acStep, sizeof(acStep), "nibble 0x%x", uiValue);
+        Compare(acStep);
+    }
+
+    // the table loop sent function sets, start from a known state again
+    LcdEmu_tap(NULL);
+    Lcd_init(CHECK_COLS, CHECK_ROWS);
+    Lcd_backlight(ENABLE);
+    g_ucBacklight = LCD_BACKLIGHT;
+    g_driver.ulBytes = 0;
+    g_reference.ulBytes = 0;
+    LcdEmu_tap(Tap);
+    for(i = 0; i < ulSteps; i++)
+    {
+        RandomStep();
+    }
+    LcdEmu_tap(NULL);
+
+    printf("steps %lu, nibbles %lu, mismatches %lu, setup errors %lu, "
+           "bytes %lu (old encoder %lu)\n", ulSteps, g_ulNibbles,
+           g_ulMismatches, g_driver.ulErrors, g_driver.ulBytes,
+           g_reference.ulBytes);
+    if(g_ulMismatches != 0 || g_driver.ulErrors != 0)
+    {
+        printf("FAIL\n");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,224 @@
+//*****************************************************************************
+//
+// Application Name     - Lcd i2c post stress test
+// Application Overview - Runs producer threads posting text, formatted text
+//                        and callbacks through i2c_lcd_task.c while the main
+//                        thread is the display task, then checks the
+//                        emulator's final screen, that every request ran
+//                        exactly once and in the order of its producer
+//
+// Usage                - lcd_post_stress [posts per producer]
+//
+//*****************************************************************************
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2c_if.h"
+#include "i2c_lcd.h"
+#include "lcd_emu.h"
+
+//*****************************************************************************
+//                      MACRO DEFINITIONS
+//*****************************************************************************
+#define FAILURE                 -1          // as returned by the library
+#define STRESS_COLS             20
+#define STRESS_ROWS             4
+#define STRESS_PRODUCERS        STRESS_ROWS // one row each
+#define STRESS_POSTS            20000       // default posts per producer
+#define STRESS_SEQ_BITS         24          // callback argument: producer, seq
+
+//*****************************************************************************
+//                      LOCAL VARIABLES
+//*****************************************************************************
+static const tLcdClock g_clock = {LcdEmu_micros, LcdEmu_sleep};
+static sem_t g_wake;
+static volatile int g_iRunning = STRESS_PRODUCERS;
+static unsigned long g_ulPosts = STRESS_POSTS;
+static unsigned long g_ulFull = 0;
+// touched by the display task only
+static unsigned long g_ulNext[STRESS_PRODUCERS];
+static unsigned long g_ulOutOfOrder = 0;
+
+//*****************************************************************************
+//
+//! Wake the display task, the Lcd_post_notify function
+//
+//*****************************************************************************
+static void
+WakeDisplayTask(void)
+{
+    sem_post(&g_wake);
+}
+
+//*****************************************************************************
+//
+//! Posted callback, checks that each producer's requests run in order
+//!
+//! \param pvArg: producer << STRESS_SEQ_BITS | sequence number
+//!
+//*****************************************************************************
+static void
+CheckOrder(void *pvArg)
+{
+    uintptr_t uArg = (uintptr_t)pvArg;
+    unsigned int uiProducer = uArg >> STRESS_SEQ_BITS;
+    unsigned long ulSeq = uArg & ((1UL << STRESS_SEQ_BITS) - 1);
+
+    if(ulSeq != g_ulNext[uiProducer])
+    {
+        g_ulOutOfOrder++;
+    }
+    g_ulNext[uiProducer] = ulSeq + 1;
+}
+
+//*****************************************************************************
+//
+//! Producer thread, posts a row update and a callback per sequence number
+//!
+//! \param pvArg: producer number, also its row
+//!
+//*****************************************************************************
+static void *
+Producer(void *pvArg)
+{
+    unsigned int uiProducer = (unsigned int)(uintptr_t)pvArg;
+    unsigned long ulFull = 0;
+    unsigned long ulSeq;
+    char acText[LCD_POST_TEXT_SIZE];
+
+    for(ulSeq = 0; ulSeq < g_ulPosts; ulSeq++)
+    {
+        // alternate both text posts, the screen shows the same either way
+        if(ulSeq & 1)
+        {
+            snprintf(acText, sizeof(acText), "P%u %06lu", uiProducer, ulSeq);
+            while(Lcd_post_text(NULL, 0, uiProducer, acText) == LCD_QUEUE_FULL)
+            {
+                ulFull++;
+                sched_yield();
+            }
+        }
+        else
+        {
+            while(Lcd_post_printf(NULL, 0, uiProducer, "P%u %06lu",
+                                  uiProducer, ulSeq) == LCD_QUEUE_FULL)
+            {
+                ulFull++;
+                sched_yield();
+            }
+        }
+        while(Lcd_post_call(NULL, CheckOrder,
+                            (void *)(((uintptr_t)uiProducer << STRESS_SEQ_BITS)
+                                     | ulSeq)) == LCD_QUEUE_FULL)
+        {
+            ulFull++;
+            sched_yield();
+        }
+    }
+    __sync_fetch_and_add(&g_ulFull, ulFull);
+    // after the last publish, the display task drains once it sees 0
+    __sync_fetch_and_sub(&g_iRunning, 1);
+    sem_post(&g_wake);
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t producers[STRESS_PRODUCERS];
+    char acRow[LCDEMU_MAX_COLS + 1];
+    char acExpect[STRESS_COLS + 1];
+    unsigned long ulRun = 0;
+    unsigned int i;
+    int iDone;
+    int iRet = 0;
+
+    if(argc == 2)
+    {
+        g_ulPosts = strtoul(argv[1], NULL, 0);
+    }
+    if(g_ulPosts == 0 || g_ulPosts >= (1UL << STRESS_SEQ_BITS))
+    {
+        fprintf(stderr, "posts per producer: 1 to %lu\n",
+                (1UL << STRESS_SEQ_BITS) - 1);
+        return 2;
+    }
+
+    LcdEmu_attach(LCDI2C_ADDRESS, STRESS_COLS, STRESS_ROWS);
+    LcdEmu_reset(100000);
+    I2C_IF_Open(I2C_MASTER_MODE_STD);
+    Lcd_clock(&g_clock);
+    Lcd_init(STRESS_COLS, STRESS_ROWS);
+    Lcd_backlight(ENABLE);
+
+    // a NULL callback or text is refused when posting, not when run
+    if(Lcd_post_call(NULL, NULL, NULL) != FAILURE || Lcd_post_service() != 0)
+    {
+        printf("NULL callback was posted\n");
+        iRet = 1;
+    }
+    if(Lcd_post_text(NULL, 0, 0, NULL) != FAILURE || Lcd_post_service() != 0)
+    {
+        printf("NULL text was posted\n");
+        iRet = 1;
+    }
+
+    sem_init(&g_wake, 0, 0);
+    Lcd_post_notify(WakeDisplayTask);
+    for(i = 0; i < STRESS_PRODUCERS; i++)
+    {
+        pthread_create(&producers[i], NULL, Producer, (void *)(uintptr_t)i);
+    }
+
+    // the display task
+    do
+    {
+        sem_wait(&g_wake);
+        iDone = (__sync_fetch_and_add(&g_iRunning, 0) == 0);
+        ulRun += Lcd_post_service();
+    } while(!iDone);
+
+    for(i = 0; i < STRESS_PRODUCERS; i++)
+    {
+        pthread_join(producers[i], NULL);
+    }
+    Lcd_post_notify(NULL);
+
+    LcdEmu_render(LCDI2C_ADDRESS, stdout);
+    printf("producers %u, posts %lu, run %lu, queue full %lu, "
+           "out of order %lu, violations %lu\n", STRESS_PRODUCERS,
+           STRESS_PRODUCERS * g_ulPosts * 2, ulRun, g_ulFull, g_ulOutOfOrder,
+           LcdEmu_stats()->violations);
+
+    if(ulRun != STRESS_PRODUCERS * g_ulPosts * 2 || g_ulOutOfOrder != 0
+       || LcdEmu_stats()->violations != 0)
+    {
+        iRet = 1;
+    }
+    for(i = 0; i < STRESS_PRODUCERS; i++)
+    {
+        if(g_ulNext[i] != g_ulPosts)
+        {
+            printf("producer %u: %lu callbacks\n", i, g_ulNext[i]);
+            iRet = 1;
+        }
+        // each row holds the last text of its producer
+        snprintf(acExpect, sizeof(acExpect), "P%u %06lu", i, g_ulPosts - 1);
+        memset(&acExpect[strlen(acExpect)], ' ',
+               STRESS_COLS - strlen(acExpect));
+        acExpect[STRESS_COLS] = '\0';
+        LcdEmu_row(LCDI2C_ADDRESS, i, acRow);
+        if(strcmp(acRow, acExpect) != 0)
+        {
+            printf("row %u: \"%s\", expected \"%s\"\n", i, acRow, acExpect);
+            iRet = 1;
+        }
+    }
+    printf("%s\n", iRet ? "FAIL" : "PASS");
+    return iRet;
+}
@@ -0,0 +1,389 @@
+//*****************************************************************************
+//
+// Application Name     - Lcd i2c trace replay
+// Application Overview - Reads the bus trace printed by Lcd_trace_dump from a
+//                        UART log, replays it against the HD44780/PCF8574T
+//                        emulator with the recorded timing, and prints the
+//                        screens, the timing violations and where the time
+//                        went
+//
+// Usage                - lcd_replay [-g 16x2] [log.txt]
+//
+//*****************************************************************************
+#include <stdio.h>
+#include <string.h>
+
+#include "i2c_if.h"
+#include "i2c_lcd.h"
+#include "lcd_emu.h"
+
+//*****************************************************************************
+//                      MACRO DEFINITIONS
+//*****************************************************************************
+#define REPLAY_MAX_BYTES        (1024 * 1024)
+#define REPLAY_POWER_UP_NS      50000000ULL
+#define REPLAY_LINE             512
+
+//*****************************************************************************
+//                      LOCAL TYPES
+//*****************************************************************************
+typedef struct
+{
+    unsigned char ucAddr;
+    unsigned long ulTransactions;
+    unsigned long ulBytes;
+    unsigned long ulReads;
+    unsigned long ulMismatches;     // pins read differ from the recording
+} tReplayDevice;
+
+//*****************************************************************************
+//                      LOCAL VARIABLES
+//*****************************************************************************
+static unsigned char g_trace[REPLAY_MAX_BYTES];
+static unsigned long g_ulTraceLen = 0;
+static unsigned long g_ulBusHz = 100000;
+static unsigned long g_ulDropped = 0;
+static tReplayDevice g_devices[LCDEMU_MAX_PANELS];
+static int g_iDevices = 0;
+
+//*****************************************************************************
+//
+//! Read the trace from a log
+//!
+//! \param pIn: log, anything outside the LCDTRACE lines is skipped
+//!
+//! \return 0 when a complete trace was found
+//
+//*****************************************************************************
+static int
+ReadTrace(FILE *pIn)
+{
+    char line[REPLAY_LINE];
+    unsigned int uiVersion, uiByte;
+    unsigned long ulLen;
+    int iInside = 0;
+    char *pcHex;
+
+    while(fgets(line, sizeof(line), pIn) != NULL)
+    {
+        if(!iInside)
+        {
+            pcHex = strstr(line, "LCDTRACE ");
+            if(pcHex != NULL &&
+               sscanf(pcHex, "LCDTRACE %u %lu %lu %lu", &uiVersion, &g_ulBusHz,
+                      &ulLen, &g_ulDropped) == 4 && uiVersion == 1)
+            {
+                iInside = 1;
+                g_ulTraceLen = 0;
+            }
+            continue;
+        }
+        if(strstr(line, "LCDTRACE END") != NULL)
+        {
+            return (g_ulTraceLen == ulLen) ? 0 : -1;
+        }
+        for(pcHex = line; pcHex[0] != '\0' && pcHex[1] != '\0'; )
+        {
+            if(sscanf(pcHex, "%2x", &uiByte) != 1 ||
+               strchr(" \t\r\n", pcHex[0]) != NULL)
+            {
+                pcHex++;
+                continue;
+            }
+            if(g_ulTraceLen == REPLAY_MAX_BYTES)
+                return -1;
+            g_trace[g_ulTraceLen++] = uiByte;
+            pcHex += 2;
+        }
+    }
+    return -1;
+}
+
+//*****************************************************************************
+//
+//! Get a varint
+//!
+//! \param pulPos: position in the trace, moved past the varint
+//!
+//! \return value
+//
+//*****************************************************************************
+static unsigned long
+GetVarint(unsigned long *pulPos)
+{
+    unsigned long ulValue = 0;
+    int iShift = 0;
+
+    while(*pulPos < g_ulTraceLen)
+    {
+        unsigned char c = g_trace[(*pulPos)++];
+        ulValue |= (unsigned long)(c & 0x7F) << iShift;
+        if(!(c & 0x80))
+            break;
+        iShift += 7;
+    }
+    return ulValue;
+}
+
+//*****************************************************************************
+//
+//! Find or add the counters of a device
+//
+//*****************************************************************************
+static tReplayDevice *
+Device(unsigned char ucAddr)
+{
+    int i;
+
+    for(i = 0; i < g_iDevices; i++)
+    {
+        if(g_devices[i].ucAddr == ucAddr)
+            return &g_devices[i];
+    }
+    if(g_iDevices == LCDEMU_MAX_PANELS)
+        return NULL;
+    memset(&g_devices[g_iDevices], 0, sizeof(tReplayDevice));
+    g_devices[g_iDevices].ucAddr = ucAddr;
+    return &g_devices[g_iDevices++];
+}
+
+//*****************************************************************************
+//
+//! Expand the run-length encoded states of a write record
+//!
+//! \param pulPos: position of the first token, moved past the states
+//! \param pucStates: output
+//! \param uiCount: number of states
+//!
+//! \return 0 when the states decode to uiCount bytes
+//
+//*****************************************************************************
+static int
+Expand(unsigned long *pulPos, unsigned char *pucStates, unsigned int uiCount)
+{
+    unsigned int uiOut = 0, uiRun;
+    unsigned char ucToken;
+
+    while(uiOut < uiCount && *pulPos < g_ulTraceLen)
+    {
+        ucToken = g_trace[(*pulPos)++];
+        if(ucToken & 0x80)
+        {
+            // the previous character again
+            uiRun = 4 * ((ucToken & 0x7F) + 1);
+            if(uiOut < 4 || uiOut + uiRun > uiCount)
+                return -1;
+            for(; uiRun > 0; uiRun--, uiOut++)
+                pucStates[uiOut] = pucStates[uiOut - 4];
+        }
+        else
+        {
+            uiRun = ucToken + 1;
+            if(uiOut + uiRun > uiCount || *pulPos + uiRun > g_ulTraceLen)
+                return -1;
+            memcpy(&pucStates[uiOut], &g_trace[*pulPos], uiRun);
+            *pulPos += uiRun;
+            uiOut += uiRun;
+        }
+    }
+    return (uiOut == uiCount) ? 0 : -1;
+}
+
+//*****************************************************************************
+//
+//! Attach an emulated panel for every address in the trace
+//
+//*****************************************************************************
+static int
+AttachDevices(unsigned char ucCols, unsigned char ucRows)
+{
+    unsigned long ulPos = 0, ulLen, ulNext;
+    unsigned char ucType;
+
+    while(ulPos < g_ulTraceLen)
+    {
+        ulLen = GetVarint(&ulPos);
+        ulNext = ulPos + ulLen;
+        if(ulLen < 2 || ulNext > g_ulTraceLen)
+            return -1;
+        ucType = g_trace[ulPos++];
+        GetVarint(&ulPos);
+        if(ucType == LCD_TRACE_WRITE || ucType == LCD_TRACE_READ)
+        {
+            if(Device(g_trace[ulPos]) == NULL)
+                return -1;
+        }
+        ulPos = ulNext;
+    }
+    for(ulPos = 0; ulPos < (unsigned long)g_iDevices; ulPos++)
+        LcdEmu_attach(g_devices[ulPos].ucAddr, ucCols, ucRows);
+    return 0;
+}
+
+//*****************************************************************************
+//
+//! Replay the trace
+//!
+//! Each record starts when the recorded time since the previous record has
+//! passed, and a write after a wait record starts when the wait is over,
+//! so a trace recorded without Lcd_clock still gets the driver's waits.
+//!
+//! \param pullIdleNs: returns the time the application used between records
+//! \param pullWaitNs: returns the time spent in the recorded waits
+//!
+//! \return 0 when every record was well formed
+//
+//*****************************************************************************
+static int
+Replay(unsigned long long *pullIdleNs, unsigned long long *pullWaitNs)
+{
+    unsigned char states[256];
+    unsigned long ulPos = 0, ulLen, ulNext, ulCount;
+    unsigned long long ullStart = LcdEmu_nowNs(), ullReady = 0, ullAt;
+    unsigned char ucType, ucValue;
+    tReplayDevice *pDev;
+
+    *pullIdleNs = 0;
+    *pullWaitNs = 0;
+    while(ulPos < g_ulTraceLen)
+    {
+        ulLen = GetVarint(&ulPos);
+        ulNext = ulPos + ulLen;
+        ucType = g_trace[ulPos++];
+        ullStart += (unsigned long long)GetVarint(&ulPos) * 1000;
+
+        ullAt = LcdEmu_nowNs();
+        if(ullReady > ullAt && ucType != LCD_TRACE_WAIT)
+        {
+            *pullWaitNs += ullReady - ullAt;
+            ullAt = ullReady;
+        }
+        if(ullStart > ullAt)
+        {
+            *pullIdleNs += ullStart - ullAt;
+            ullAt = ullStart;
+        }
+        LcdEmu_advanceNs(ullAt - LcdEmu_nowNs());
+        // later records are timed from here, as on the target
+        ullStart = ullAt;
+
+        switch(ucType)
+        {
+        case LCD_TRACE_WRITE:
+            pDev = Device(g_trace[ulPos++]);
+            ulCount = g_trace[ulPos++];
+            if(Expand(&ulPos, states, ulCount) != 0)
+                return -1;
+            I2C_IF_Write(pDev->ucAddr, states, ulCount, 1);
+            pDev->ulTransactions++;
+            pDev->ulBytes += ulCount;
+            ullReady = 0;
+            break;
+        case LCD_TRACE_READ:
+            pDev = Device(g_trace[ulPos++]);
+            I2C_IF_Read(pDev->ucAddr, &ucValue, 1);
+            if(ucValue != g_trace[ulPos])
+                pDev->ulMismatches++;
+            pDev->ulReads++;
+            pDev->ulTransactions++;
+            break;
+        case LCD_TRACE_WAIT:
+            // waits in a row overlap, the longest one counts
+            ullAt += (unsigned long long)GetVarint(&ulPos) * 1000;
+            if(ullAt > ullReady)
+                ullReady = ullAt;
+            break;
+        default:
+            return -1;
+        }
+        ulPos = ulNext;
+    }
+    if(ullReady > LcdEmu_nowNs())
+    {
+        *pullWaitNs += ullReady - LcdEmu_nowNs();
+        LcdEmu_advanceNs(ullReady - LcdEmu_nowNs());
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned int uiCols = 16, uiRows = 2;
+    unsigned long long ullIdleNs, ullWaitNs, ullStartNs, ullTotalNs;
+    tLcdEmuStats *pStats;
+    FILE *pIn = stdin;
+    int i;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+        {
+            if(sscanf(argv[++i], "%ux%u", &uiCols, &uiRows) != 2 ||
+               uiCols == 0 || uiCols > LCDEMU_MAX_COLS ||
+               uiRows == 0 || uiRows > LCDEMU_MAX_ROWS)
+            {
+                fprintf(stderr, "bad geometry %s\n", argv[i]);
+                return 2;
+            }
+        }
+        else if(pIn == stdin && argv[i][0] != '-')
+        {
+            pIn = fopen(argv[i], "r");
+            if(pIn == NULL)
+            {
+                perror(argv[i]);
+                return 2;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-g 16x2] [log.txt]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if(ReadTrace(pIn) != 0)
+    {
+        fprintf(stderr, "no complete LCDTRACE block found\n");
+        return 2;
+    }
+    if(AttachDevices(uiCols, uiRows) != 0)
+    {
+        fprintf(stderr, "malformed trace\n");
+        return 2;
+    }
+    if(g_ulDropped)
+    {
+        printf("warning: %lu records were dropped from the start of the trace,"
+               " a trace that does not start at Lcd_init may not replay\n\n",
+               g_ulDropped);
+    }
+
+    LcdEmu_reset(g_ulBusHz);
+    LcdEmu_advanceNs(REPLAY_POWER_UP_NS);
+    ullStartNs = LcdEmu_nowNs();
+    if(Replay(&ullIdleNs, &ullWaitNs) != 0)
+    {
+        fprintf(stderr, "malformed trace\n");
+        return 2;
+    }
+    ullTotalNs = LcdEmu_nowNs() - ullStartNs;
+    pStats = LcdEmu_stats();
+
+    for(i = 0; i < g_iDevices; i++)
+    {
+        printf("0x%02x: transactions %lu, bytes %lu, reads %lu, "
+               "read mismatches %lu\n", g_devices[i].ucAddr,
+               g_devices[i].ulTransactions, g_devices[i].ulBytes,
+               g_devices[i].ulReads, g_devices[i].ulMismatches);
+        LcdEmu_render(g_devices[i].ucAddr, stdout);
+        printf("\n");
+    }
+    printf("bus %luHz, %lu trace bytes\n", g_ulBusHz, g_ulTraceLen);
+    printf("time %lluus: bus %lluus, waits %lluus, application %lluus\n",
+           ullTotalNs / 1000, pStats->busNs / 1000, ullWaitNs / 1000,
+           ullIdleNs / 1000);
+    printf("violations %lu\n", pStats->violations);
+    return pStats->violations ? 1 : 0;
+}
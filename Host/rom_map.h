@@ -0,0 +1,22 @@
+//*****************************************************************************
+// rom_map.h
+//
+// Host build stand-in for the CC3200 driverlib ROM mapping header. Only the
+// calls used by the lcd library are provided, by the emulator in lcd_emu.c
+//
+//*****************************************************************************
+#ifndef __ROM_MAP_H__
+#define __ROM_MAP_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+void MAP_UtilsDelay(unsigned long ulCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ROM_MAP_H__
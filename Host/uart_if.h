@@ -0,0 +1,25 @@
+//*****************************************************************************
+// uart_if.h
+//
+// Host build stand-in for the CC3200 SDK common UART interface, output goes
+// to stdout
+//
+//*****************************************************************************
+#ifndef __UART_IF_H__
+#define __UART_IF_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define UART_PRINT              Report
+
+void Message(const char *str);
+int Report(const char *format, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UART_IF_H__
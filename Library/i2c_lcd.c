@@ -10,10 +10,9 @@
 //
 //*****************************************************************************
 // Standard includes
+#include <limits.h>
 #include <stdarg.h>
-#include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
 
 #include "i2c_if.h"
 #include "i2c_lcd.h"
@@ -32,6 +31,33 @@
 #define US_DELAY(x)				MAP_UtilsDelay(x * (80 / 5));
 #define MS_DELAY(x)				MAP_UtilsDelay(x * (80000 / 5));
 #define SEC_DELAY(x)			MAP_UtilsDelay(x * (80000000 / 5));
+#define LCD_ADDR_UNKNOWN		0xFF
+#define LCD_CELL_UNKNOWN		0x100	// never equal to a character code
+#define LCD_FMT_LEFT			0x01	// '-' flag, left justify
+#define LCD_FMT_ZERO			0x02	// '0' flag, pad with zeros
+#define LCD_FMT_LONG			0x04	// 'l' length modifier
+// digits of the longest unsigned long, in base 10 or 16
+#define LCD_FMT_DIGITS			(sizeof(unsigned long) * CHAR_BIT / 3 + 1)
+// %f values from 2^(bits of unsigned long) up print LCD_FMT_OVERFLOW
+#define LCD_FMT_RANGE			((double)(1UL << (sizeof(unsigned long) \
+										* CHAR_BIT - 1)) * 2.0)
+#define LCD_FMT_OVERFLOW		"ovf"
+#define LCD_QUEUE_MASK			(LCD_QUEUE_SIZE - 1)
+#define LCD_QUEUE_WAIT			0x8000	// entry is a wait in microseconds
+#define LCD_QUEUE_MAX_WAIT		0x7FFF
+#define LCD_QUEUE_RETRY_US		1000	// wait before a write the port refused
+#define LCD_BUSY_FLAG			0x80
+#define LCD_BUSY_POLLS			32
+#define LCD_GLYPH_NONE			0xFF	// CGRAM slot holds no cached glyph
+#define LCD_GLYPH_USER			0xFE	// slot written by Lcd_createChar
+#define LCD_SNAPSHOT_MAGIC		0x6		// top 3 bits of a valid snapshot
+#define LCD_ROM_UNKNOWN			'?'		// code point without a ROM or CGRAM glyph
+// Lcd_init_tick steps, LCD_INIT_DONE is 0 so a zeroed handle is initialized
+#define LCD_INIT_DONE			0
+#define LCD_INIT_POWERUP		1
+#define LCD_INIT_SECOND			2
+#define LCD_INIT_THIRD			3
+#define LCD_INIT_ENTRY			4
 
 extern int
 I2C_IF_Write(unsigned char ucDevAddr,
@@ -39,313 +65,3658 @@ I2C_IF_Write(unsigned char ucDevAddr,
 		unsigned char ucLen,
 		unsigned char ucStop);
 
+extern int
+I2C_IF_Read(unsigned char ucDevAddr,
+		unsigned char *pucData,
+		unsigned char ucLen);
+
 extern void MAP_UtilsDelay(unsigned long ulCount);
+
+//*****************************************************************************
+//                      LOCAL VARIABLES
+//*****************************************************************************
+static unsigned char _burstBuf[LCD_BURST_SIZE];
+static unsigned char _burstLen = 0;
+static unsigned char _burstDepth = 0;
+// display shift and entry mode when the outermost burst began
+static unsigned char _burstShift;
+static unsigned char _burstEntry;
+
+// execution time of each instruction in microseconds, indexed by its highest
+// set bit: clear display, return home, entry mode, display control, shift,
+// function set, CGRAM address and DDRAM address
+static const unsigned short _execUs[8] = {
+	LCD_CLEAR_US, LCD_CLEAR_US, 37, 37, 37, 37, 37, 37
+};
+
+// display used when the application never calls Lcd_open
+static tLcd _lcdDefault = {
+	.addr = LCDI2C_ADDRESS,
+	.hwAddr = LCD_ADDR_UNKNOWN,
+	.entryLeft = 1,
+	.expState = 0xFF
+};
+// selected display, every Lcd_ call works on it
+static tLcd *_lcd = &_lcdDefault;
+static tLcd *_devices[LCD_MAX_DEVICES] = { &_lcdDefault };
+static unsigned char _deviceCount = 1;
+
+// bus scheduler state shared by every display
+static volatile unsigned char _qBusy = 0;
+static unsigned char _qTx[LCD_BURST_SIZE];
+static unsigned char _qNext = 0;
+static unsigned long _qInFlightUs = 0;
+static unsigned char _qBudget = LCD_BURST_SIZE;
+static unsigned long _busHz = 100000;
+static unsigned char _asyncMode = DISABLE;
+static const tLcdPort *_port = NULL;
+
+// microsecond clock, NULL times the command gaps with UtilsDelay
+static const tLcdClock *_clock = NULL;
+
+#ifdef LCD_STATS
+static tLcdStats _stats;
+static unsigned long (*_statTicks)(void) = NULL;
+static unsigned long _statTicksPerUs = 1;
+static unsigned long _statStart;
+static unsigned long _statSleep;		// sleepUs when the outer call started
+static unsigned char _statDepth = 0;
+static const char * const _statNames[LCD_STAT_CALLS] = {
+	"Lcd_init", "Lcd_clear", "Lcd_home", "Lcd_gotoxy", "Lcd_Print",
+	"Lcd_message", "Lcd_createChar", "Lcd_flush", "Lcd_service"
+};
+#define LCD_STAT_ADD(field, n)	(_stats.field += (n))
+#define LCD_STAT_ENTER()		Lcd_stats_enter()
+#define LCD_STAT_EXIT(call)		Lcd_stats_exit(call)
+#else
+// statements that do nothing, safe as the body of an if
+#define LCD_STAT_ADD(field, n)	((void)0)
+#define LCD_STAT_ENTER()		((void)0)
+#define LCD_STAT_EXIT(call)		((void)0)
+#endif
+
+#ifdef LCD_TRACE
+// ring of records, each one starts with its length as a varint
+static unsigned char _trace[LCD_TRACE_SIZE];
+static unsigned int _traceHead = 0;		// oldest record
+static unsigned int _traceLen = 0;
+static unsigned long _traceDropped = 0;	// records pushed out of the ring
+static unsigned long _traceLast;		// clock time of the last record
+static unsigned char _traceOn = DISABLE;
+// record being built, a write can take a token every 128 states
+static unsigned char _traceRec[LCD_BURST_SIZE + LCD_BURST_SIZE / 128 + 16];
+#define LCD_TRACE_BUS(addr, data, len)	Lcd_trace_write(addr, data, len)
+#define LCD_TRACE_PINS(addr, value)		Lcd_trace_read_rec(addr, value)
+#define LCD_TRACE_DELAY(us)				Lcd_trace_wait(us)
+#define LCD_TRACE_QUEUE(from, to)		Lcd_trace_queue(from, to)
+#else
+#define LCD_TRACE_BUS(addr, data, len)	((void)0)
+#define LCD_TRACE_PINS(addr, value)		((void)0)
+#define LCD_TRACE_DELAY(us)				((void)0)
+#define LCD_TRACE_QUEUE(from, to)		((void)0)
+#endif
+
+// time base of the field refresh intervals
+static unsigned long (*_fieldClock)(void) = NULL;
+static unsigned long _serviceCount = 0;
+// cells sent by the last Lcd_flush
+static unsigned int _flushSent = 0;
+
+// glyph bitmaps shared by every display
+static const unsigned char (*_glyphTable)[8] = NULL;
+static unsigned char _glyphCount = 0;
+// code point of every glyph, the CGRAM fallback of the UTF-8 translation
+static const unsigned short *_glyphCodes = NULL;
+
+//*****************************************************************************
+// Expander states of every byte: high nibble with E high, high nibble with E
+// low, then the same for the low nibble. RS and the backlight are added when
+// sending. The lcd latches each nibble on the falling edge of E.
+//*****************************************************************************
+#define LCD_ENC(v)		{ ((v) & 0xF0) | En, (v) & 0xF0, \
+						  (((v) << 4) & 0xF0) | En, ((v) << 4) & 0xF0 }
+#define LCD_ENC4(v)		LCD_ENC(v), LCD_ENC((v) + 1), LCD_ENC((v) + 2), LCD_ENC((v) + 3)
+#define LCD_ENC16(v)	LCD_ENC4(v), LCD_ENC4((v) + 4), LCD_ENC4((v) + 8), LCD_ENC4((v) + 12)
+#define LCD_ENC64(v)	LCD_ENC16(v), LCD_ENC16((v) + 16), LCD_ENC16((v) + 32), LCD_ENC16((v) + 48)
+static const unsigned char _encode[256][4] = {
+	LCD_ENC64(0), LCD_ENC64(64), LCD_ENC64(128), LCD_ENC64(192)
+};
+
+//*****************************************************************************
+// UTF-8 translation. The lead byte gives the sequence length, 0 for the
+// continuation bytes and the invalid leads. Each ROM has a range that maps
+// with an offset and a table of the other code points, sorted for a binary
+// search. ASCII is the same in both ROMs except two A00 codes, shown in
+// _romA00Ascii, that have no ROM glyph.
+//*****************************************************************************
+static const unsigned char _utf8Len[32] = {
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	// 0x00-0x7F
+	0, 0, 0, 0, 0, 0, 0, 0,							// 0x80-0xBF
+	2, 2, 2, 2, 3, 3, 4, 0							// 0xC0-0xFF
+};
+
+// A00, Japanese standard font
+static const unsigned char _romA00Ascii[16] = {	// 1 bit per code, 1 unmapped
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10, 0, 0, 0, 0x40	// '\\' and '~'
+};
+static const unsigned short _romA00Code[] = {
+	0x00A2, 0x00A5, 0x00B0, 0x00B5, 0x00DF, 0x00E4, 0x00F1, 0x00F6,
+	0x00F7, 0x00FC, 0x03A3, 0x03A9, 0x03B1, 0x03B2, 0x03B5, 0x03B8,
+	0x03BC, 0x03C0, 0x03C1, 0x03C3, 0x2190, 0x2192, 0x221A, 0x221E,
+	0x2588, 0x3001, 0x3002, 0x300C, 0x300D, 0x30FB, 0x30FC
+};
+static const unsigned char _romA00Char[] = {
+	0xEC, 0x5C, 0xDF, 0xE4, 0xE2, 0xE1, 0xEE, 0xEF,
+	0xFD, 0xF5, 0xF6, 0xF4, 0xE0, 0xE2, 0xE3, 0xF2,
+	0xE4, 0xF7, 0xE6, 0xE5, 0x7F, 0x7E, 0xE8, 0xF3,
+	0xFF, 0xA4, 0xA1, 0xA2, 0xA3, 0xA5, 0xB0
+};
+#define LCD_A00_RANGE_FIRST		0xFF61	// half-width katakana
+#define LCD_A00_RANGE_LAST		0xFF9F
+#define LCD_A00_RANGE_CHAR		0xA1
+
+// A02, European standard font
+static const unsigned char _romA02Ascii[16] = { 0 };
+static const unsigned short _romA02Code[] = {
+	0x0393, 0x0398, 0x03A3, 0x03A9, 0x03B1, 0x03B4, 0x03B5, 0x03C0,
+	0x03C3, 0x03C4, 0x2190, 0x2191, 0x2192, 0x2193, 0x221E, 0x2229,
+	0x2264, 0x2265, 0x2665, 0x266A
+};
+static const unsigned char _romA02Char[] = {
+	0x92, 0x99, 0x94, 0x9A, 0x90, 0x9B, 0x9E, 0x93,
+	0x95, 0x97, 0x1B, 0x18, 0x1A, 0x19, 0x9C, 0x9F,
+	0x1C, 0x1D, 0x9D, 0x91
+};
+#define LCD_A02_RANGE_FIRST		0x00A0	// Latin-1 at the same codes
+#define LCD_A02_RANGE_LAST		0x00FF
+#define LCD_A02_RANGE_CHAR		0xA0
+
+typedef struct
+{
+	const unsigned char *pucAscii;
+	const unsigned short *pusCode;
+	const unsigned char *pucChar;
+	unsigned char ucCount;
+	unsigned short usFirst;
+	unsigned short usLast;
+	unsigned char ucFirstChar;
+} tLcdRom;
+
+static const tLcdRom _roms[2] = {
+	{ _romA00Ascii, _romA00Code, _romA00Char, sizeof(_romA00Char),
+	  LCD_A00_RANGE_FIRST, LCD_A00_RANGE_LAST, LCD_A00_RANGE_CHAR },
+	{ _romA02Ascii, _romA02Code, _romA02Char, sizeof(_romA02Char),
+	  LCD_A02_RANGE_FIRST, LCD_A02_RANGE_LAST, LCD_A02_RANGE_CHAR }
+};
+
 //****************************************************************************
 //                      LOCAL FUNCTION DEFINITIONS
 //****************************************************************************
+static void Lcd_mirror_invalidate();
+static void Lcd_send_data(const unsigned char *pucData, unsigned int uiLen);
+static unsigned int Lcd_message_rom(const char *str, unsigned int uiCols);
+static int Lcd_queue_pending();
+
+#ifdef LCD_STATS
+//****************************************************************************
+//
+//! Read the instrumentation clock
+//!
+//! \return ticks of the Lcd_stats_clock source, or microseconds of the
+//!		   driver clock when none was set
+//
+//****************************************************************************
+static unsigned long Lcd_stats_ticks() {
+	return (_statTicks != NULL) ? _statTicks() : Lcd_micros();
+}
+
+//****************************************************************************
+//
+//! Start timing a public call
+//!
+//! \Note: calls made from inside another timed call are part of the outer
+//!		   one and are not counted on their own.
+//
+//****************************************************************************
+static void Lcd_stats_enter() {
+	if (_statDepth++ == 0) {
+		_statStart = Lcd_stats_ticks();
+		_statSleep = _stats.sleepUs;
+	}
+}
+
+//****************************************************************************
+//
+//! Finish timing a public call
+//!
+//! \param ucCall: LCD_STAT_ index of the call
+//!
+//! This function
+//!    1. Adds the call time to the totals and the log2 histogram
+//!    2. Adds the part of it the CPU was not asleep to the active time
+//
+//****************************************************************************
+static void Lcd_stats_exit(unsigned char ucCall) {
+	unsigned long ulUs, ulSlept;
+	unsigned char ucBucket = 0;
+
+	if (--_statDepth > 0)
+		return;
+	ulUs = (Lcd_stats_ticks() - _statStart) / _statTicksPerUs;
+	ulSlept = _stats.sleepUs - _statSleep;
+	_stats.activeUs += (ulUs > ulSlept) ? ulUs - ulSlept : 0;
+	_stats.calls[ucCall]++;
+	_stats.totalUs[ucCall] += ulUs;
+	if (ulUs > _stats.maxUs[ucCall])
+		_stats.maxUs[ucCall] = ulUs;
+	while (ulUs > 1 && ucBucket < LCD_STAT_BUCKETS - 1) {
+		ulUs >>= 1;
+		ucBucket++;
+	}
+	_stats.hist[ucCall][ucBucket]++;
+}
+#endif
+
+#ifdef LCD_TRACE
+//****************************************************************************
+//
+//! Put a varint
+//!
+//! \param pucOut: output
+//! \param ulValue: value, 7 bits a byte from the lowest, bit 7 set on all
+//!		   but the last byte
+//!
+//! \return bytes written
+//
+//****************************************************************************
+static unsigned int Lcd_trace_varint(unsigned char *pucOut, unsigned long ulValue) {
+	unsigned int i = 0;
+	while (ulValue >= 0x80) {
+		pucOut[i++] = (ulValue & 0x7F) | 0x80;
+		ulValue >>= 7;
+	}
+	pucOut[i++] = ulValue;
+	return i;
+}
+
+//****************************************************************************
+//
+//! Start a record
+//!
+//! \param ucType: LCD_TRACE_ record type
+//!
+//! This function
+//!    1. Writes the type and the microseconds since the last record into
+//!		  _traceRec, after room for the length
+//!
+//! \return bytes used so far
+//
+//****************************************************************************
+static unsigned int Lcd_trace_begin(unsigned char ucType) {
+	unsigned long ulNow = Lcd_micros();
+	unsigned int uiLen = 2;
+	_traceRec[1] = ucType;
+	uiLen += Lcd_trace_varint(&_traceRec[uiLen], ulNow - _traceLast);
+	_traceLast = ulNow;
+	return uiLen;
+}
+
+//****************************************************************************
+//
+//! Store a record
+//!
+//! \param uiLen: bytes of the record in _traceRec, from the type on
+//!
+//! This function
+//!    1. Drops the oldest records until the new one fits in the ring
+//!    2. Copies the length and the record into the ring
+//
+//****************************************************************************
+static void Lcd_trace_end(unsigned int uiLen) {
+	unsigned char aucLen[3];
+	unsigned int uiHdr = Lcd_trace_varint(aucLen, uiLen - 1);
+	unsigned int uiRec, uiPos, i;
+	unsigned char c;
+
+	if (uiLen - 1 + uiHdr > LCD_TRACE_SIZE) {
+		_traceDropped++;
+		return;
+	}
+	while (LCD_TRACE_SIZE - _traceLen < uiLen - 1 + uiHdr) {
+		uiRec = 0;
+		i = 0;
+		do {
+			c = _trace[(_traceHead + i) % LCD_TRACE_SIZE];
+			uiRec |= (unsigned int)(c & 0x7F) << (7 * i);
+			i++;
+		} while (c & 0x80);
+		uiRec += i;
+		_traceHead = (_traceHead + uiRec) % LCD_TRACE_SIZE;
+		_traceLen -= uiRec;
+		_traceDropped++;
+	}
+	uiPos = (_traceHead + _traceLen) % LCD_TRACE_SIZE;
+	for (i = 0; i < uiHdr; i++) {
+		_trace[uiPos] = aucLen[i];
+		uiPos = (uiPos + 1) % LCD_TRACE_SIZE;
+	}
+	for (i = 1; i < uiLen; i++) {
+		_trace[uiPos] = _traceRec[i];
+		uiPos = (uiPos + 1) % LCD_TRACE_SIZE;
+	}
+	_traceLen += uiLen - 1 + uiHdr;
+}
+
+//****************************************************************************
+//
+//! Record an I2C write
+//!
+//! \param ucAddr: 7-bit device address
+//! \param pucData: expander states
+//! \param ucLen: number of states
+//!
+//! This function
+//!    1. Writes the address and the number of states
+//!    2. Run-length encodes the states: a token below 0x80 is followed by
+//!		  token + 1 literal states, a token from 0x80 on repeats the last
+//!		  4 states (token & 0x7F) + 1 times, a character is 4 states so a
+//!		  run of blanks takes a byte
+//
+//****************************************************************************
+static void Lcd_trace_write(unsigned char ucAddr, const unsigned char *pucData,
+		unsigned char ucLen) {
+	unsigned int uiLen, uiLit = 0, uiToken = 0, i = 0, k;
+
+	if (_traceOn != ENABLE)
+		return;
+	uiLen = Lcd_trace_begin(LCD_TRACE_WRITE);
+	_traceRec[uiLen++] = ucAddr;
+	_traceRec[uiLen++] = ucLen;
+	while (i < ucLen) {
+		k = 0;
+		if (i >= 4) {
+			while (k < 128 && i + 4 * (k + 1) <= ucLen
+					&& memcmp(&pucData[i + 4 * k], &pucData[i - 4], 4) == 0)
+				k++;
+		}
+		if (k > 0) {
+			_traceRec[uiLen++] = 0x80 | (k - 1);
+			i += 4 * k;
+			uiLit = 0;
+			continue;
+		}
+		if (uiLit == 0 || uiLit == 128) {
+			uiToken = uiLen++;
+			uiLit = 0;
+		}
+		_traceRec[uiToken] = uiLit++;
+		_traceRec[uiLen++] = pucData[i++];
+	}
+	Lcd_trace_end(uiLen);
+}
+
+//****************************************************************************
+//
+//! Record an I2C read
+//!
+//! \param ucAddr: 7-bit device address
+//! \param ucValue: pins read
+//
+//****************************************************************************
+static void Lcd_trace_read_rec(unsigned char ucAddr, unsigned char ucValue) {
+	unsigned int uiLen;
+
+	if (_traceOn != ENABLE)
+		return;
+	uiLen = Lcd_trace_begin(LCD_TRACE_READ);
+	_traceRec[uiLen++] = ucAddr;
+	_traceRec[uiLen++] = ucValue;
+	Lcd_trace_end(uiLen);
+}
+
+//****************************************************************************
+//
+//! Record a wait
+//!
+//! \param ulUs: microseconds the lcd needs before the next write
+//
+//****************************************************************************
+static void Lcd_trace_wait(unsigned long ulUs) {
+	unsigned int uiLen;
+
+	if (_traceOn != ENABLE)
+		return;
+	uiLen = Lcd_trace_begin(LCD_TRACE_WAIT);
+	uiLen += Lcd_trace_varint(&_traceRec[uiLen], ulUs);
+	Lcd_trace_end(uiLen);
+}
+
+//****************************************************************************
+//
+//! Record the entries published to the transmit port
+//!
+//! \param usFrom: first entry of the selected display queue
+//! \param usTo: entry after the last one
+//!
+//! This function
+//!    1. Records each run of expander states as a write and each run of
+//!		  waits as one wait, in the order they were queued
+//!
+//! \Note: the port drains the queue from its interrupts, where neither the
+//!		   clock nor the ring may be touched, so the queue is recorded here
+//!		   from thread context, timed when queued rather than when sent.
+//
+//****************************************************************************
+static void Lcd_trace_queue(unsigned short usFrom, unsigned short usTo) {
+	unsigned char aucStates[LCD_BURST_SIZE];
+	unsigned long ulWait = 0;
+	unsigned short entry;
+	unsigned char len = 0;
+
+	if (_traceOn != ENABLE)
+		return;
+	while (usFrom != usTo) {
+		entry = _lcd->queue[usFrom];
+		usFrom = (usFrom + 1) & LCD_QUEUE_MASK;
+		if (entry & LCD_QUEUE_WAIT) {
+			if (len != 0)
+				Lcd_trace_write(_lcd->addr, aucStates, len);
+			len = 0;
+			ulWait += entry & LCD_QUEUE_MAX_WAIT;
+			continue;
+		}
+		if (ulWait != 0)
+			Lcd_trace_wait(ulWait);
+		ulWait = 0;
+		aucStates[len++] = (unsigned char)entry;
+		if (len == LCD_BURST_SIZE) {
+			Lcd_trace_write(_lcd->addr, aucStates, len);
+			len = 0;
+		}
+	}
+	if (len != 0)
+		Lcd_trace_write(_lcd->addr, aucStates, len);
+	if (ulWait != 0)
+		Lcd_trace_wait(ulWait);
+}
+#endif
+
+//****************************************************************************
+//
+//! Write to the I2C bus
+//!
+//! \param ucAddr: 7-bit device address
+//! \param pucData: expander states
+//! \param ucLen: number of states
+//!
+//! This function
+//!    1. Sends the states with I2C_IF_Write in one transaction
+//!    2. Counts the transaction, its bytes and failures in LCD_STATS builds
+//!
+//! \return i2c writing failure or success
+//
+//****************************************************************************
+static int Lcd_i2c_write(unsigned char ucAddr, unsigned char *pucData,
+		unsigned char ucLen) {
+	LCD_STAT_ADD(transactions, 1);
+	LCD_STAT_ADD(bytes, ucLen);
+	LCD_TRACE_BUS(ucAddr, pucData, ucLen);
+	if (I2C_IF_Write(ucAddr, pucData, ucLen, 1) == 0)
+		return SUCCESS;
+	LCD_STAT_ADD(failures, 1);
+	return FAILURE;
+}
+
+//****************************************************************************
+//
+//! Read a byte from the I2C bus
+//!
+//! \param ucAddr: 7-bit device address
+//! \param pucValue: returns the expander pins
+//!
+//! \return i2c reading failure or success
+//
+//****************************************************************************
+static int Lcd_i2c_read(unsigned char ucAddr, unsigned char *pucValue) {
+	LCD_STAT_ADD(transactions, 1);
+	LCD_STAT_ADD(bytes, 1);
+	if (I2C_IF_Read(ucAddr, pucValue, 1) == 0) {
+		LCD_TRACE_PINS(ucAddr, *pucValue);
+		return SUCCESS;
+	}
+	LCD_STAT_ADD(failures, 1);
+	return FAILURE;
+}
+
+//****************************************************************************
+//
+//! Wait for the gap after the last write
+//!
+//! This function
+//!    1. With a clock waits until the selected lcd finished the last
+//!		  command, usually already past as the bus is slower than the lcd
+//!    2. Otherwise waits a fixed 120us guard unless busy flag mode is on
+//
+//****************************************************************************
+static void Lcd_gap_wait() {
+	if (_clock != NULL)
+		Lcd_wait_until(_lcd->readyAt);
+	else if (_lcd->busyMode != ENABLE) {
+		LCD_STAT_ADD(waitUs, 120);
+		LCD_TRACE_DELAY(120);
+		US_DELAY(120);
+	}
+}
+
+//****************************************************************************
+//
+//! Start a gap
+//!
+//! \param us: microseconds from now before the lcd accepts the next write
+//!
+//! \Note: an earlier gap is never shortened, the later deadline wins.
+//
+//****************************************************************************
+static void Lcd_gap_set(unsigned long us) {
+	unsigned long ulDeadline = Lcd_micros() + us;
+	if ((long)(ulDeadline - _lcd->readyAt) > 0)
+		_lcd->readyAt = ulDeadline;
+}
+
+//****************************************************************************
+//
+//! Flush the burst buffer
+//!
+//! This function
+//!    1. Sends every queued expander state in a single I2C transaction
+//!
+//! \return i2c writing failure or success
+//
+//****************************************************************************
+static int Lcd_burst_flush() {
+	unsigned char len = _burstLen;
+	if (len == 0)
+		return SUCCESS;
+	_burstLen = 0;
+	Lcd_gap_wait();
+	if(Lcd_i2c_write(_lcd->addr, _burstBuf, len) == SUCCESS)
+	{
+		Lcd_gap_set(LCD_EXEC_US);
+		return SUCCESS;
+	}
+	DBG_PRINT("I2C burst write failed\n\r");
+	return FAILURE;
+}
+
+//****************************************************************************
+//
+//! Add an entry to the transmit queue
+//!
+//! \param entry: expander state, or LCD_QUEUE_WAIT with the microseconds
+//!
+//! \return LCD_QUEUE_FULL when the entry did not fit, success otherwise
+//
+//****************************************************************************
+static int Lcd_queue_push(unsigned short entry) {
+	if (_lcd->qOverflow)
+		return LCD_QUEUE_FULL;
+	if (((_lcd->qWrite + 1) & LCD_QUEUE_MASK) == _lcd->qTail) {
+		_lcd->qOverflow = 1;
+		return LCD_QUEUE_FULL;
+	}
+	_lcd->queue[_lcd->qWrite] = entry;
+	_lcd->qWrite = (_lcd->qWrite + 1) & LCD_QUEUE_MASK;
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Publish the queued entries
+//!
+//! This function
+//!    1. Drops everything queued since the last commit if any entry did
+//!		  not fit, so the lcd never gets half a command
+//!    2. Makes the entries visible to the transmit port and starts it
+//!
+//! \return LCD_QUEUE_FULL when the entries were dropped, success otherwise
+//
+//****************************************************************************
+static int Lcd_queue_commit() {
+	if (_lcd->qOverflow) {
+		_lcd->qOverflow = 0;
+		_lcd->qWrite = _lcd->qHead;
+		// the mirrors already describe the dropped bytes
+		Lcd_mirror_invalidate();
+		_lcd->hwAddr = LCD_ADDR_UNKNOWN;
+		_lcd->shift = _burstShift;
+		_lcd->entryLeft = _burstEntry >> 1;
+		_lcd->entryShift = _burstEntry & 1;
+		return LCD_QUEUE_FULL;
+	}
+	if (_lcd->qHead == _lcd->qWrite)
+		return SUCCESS;
+	if (_port != NULL)
+		LCD_TRACE_QUEUE(_lcd->qHead, _lcd->qWrite);
+	_lcd->qHead = _lcd->qWrite;
+#ifdef LCD_STATS
+	if (((_lcd->qHead - _lcd->qTail) & LCD_QUEUE_MASK) > _stats.queueMax)
+		_stats.queueMax = (_lcd->qHead - _lcd->qTail) & LCD_QUEUE_MASK;
+#endif
+	if (_port != NULL && _port->pfnKick != NULL)
+		_port->pfnKick();
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Wait for the lcd
+//!
+//! \param us: microseconds to wait
+//!
+//! This function
+//!    1. Sends any pending burst first, so the wait starts after the
+//!       command actually reached the display
+//!    2. With a clock only sets the deadline of the next write, so the
+//!		  wait overlaps whatever the caller does until then
+//!    3. Otherwise delays the function for approximately us microseconds
+//
+//****************************************************************************
+static void Lcd_delay_us(unsigned long us) {
+	if (_asyncMode == ENABLE) {
+		Lcd_burst_begin();
+		while (us > LCD_QUEUE_MAX_WAIT) {
+			Lcd_queue_push(LCD_QUEUE_WAIT | LCD_QUEUE_MAX_WAIT);
+			us -= LCD_QUEUE_MAX_WAIT;
+		}
+		Lcd_queue_push(LCD_QUEUE_WAIT | us);
+		Lcd_burst_end();
+		return;
+	}
+	Lcd_burst_flush();
+	LCD_TRACE_DELAY(us);
+	if (_clock != NULL) {
+		Lcd_gap_set(us);
+	} else {
+		LCD_STAT_ADD(waitUs, us);
+		US_DELAY(us);
+	}
+}
+
+//****************************************************************************
+//
+//! Read bytes from the lcd
+//!
+//! \param mode: COMMAND reads the busy flag and address counter,
+//!		   DATA reads the DDRAM or CGRAM from the address counter on
+//! \param pucValue: returns the bytes read
+//! \param ucLen: number of bytes
+//!
+//! This function
+//!    1. Sets D7..D4 high so the PCF8574T pins can be pulled low by the lcd,
+//!		  and raises RW
+//!    2. Pulses E twice a byte, reading the high and then the low nibble
+//!		  back through the expander while E is high. Each pulse lowers E of
+//!		  the previous one in the same write, E goes low once at the end.
+//!
+//! \return i2c failure or success
+//
+//****************************************************************************
+static int Lcd_read_bytes(unsigned char mode, unsigned char *pucValue,
+		unsigned char ucLen) {
+	unsigned char ucState = 0xF0 | Rw | mode | _lcd->backlightval;
+	unsigned char aucPulse[2];
+	unsigned char aucNibble[2];
+	int i;
+
+	RET_IF_ERR(Lcd_burst_flush());
+	_lcd->expState = ucState | En;
+	while (ucLen-- > 0) {
+		for (i = 0; i < 2; i++) {
+			aucPulse[0] = ucState;
+			aucPulse[1] = ucState | En;
+			if (Lcd_i2c_write(_lcd->addr, aucPulse, 2) != SUCCESS
+					|| Lcd_i2c_read(_lcd->addr, &aucNibble[i]) != SUCCESS) {
+				DBG_PRINT("I2C read failed\n\r");
+				return FAILURE;
+			}
+		}
+		*pucValue++ = (aucNibble[0] & 0xF0) | (aucNibble[1] >> 4);
+	}
+	_lcd->expState = ucState;
+	if (Lcd_i2c_write(_lcd->addr, &ucState, 1) != SUCCESS)
+		return FAILURE;
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Wait until the lcd finished a command
+//!
+//! \param us: worst case execution time of the command
+//!
+//! This function
+//!    1. In busy flag mode polls the busy flag, so the wait ends as soon
+//!		  as the lcd is ready
+//!    2. Otherwise, or if polling fails, waits the worst case time
+//
+//****************************************************************************
+static void Lcd_wait_ready(unsigned long us) {
+	unsigned char ucStatus;
+	int i;
+	if (_lcd->busyMode == ENABLE && _asyncMode != ENABLE) {
+		for (i = 0; i < LCD_BUSY_POLLS; i++) {
+			if (Lcd_read_bytes(COMMAND, &ucStatus, 1) != SUCCESS)
+				break;
+			if (!(ucStatus & LCD_BUSY_FLAG))
+				return;
+		}
+	}
+	Lcd_delay_us(us);
+}
+
+//****************************************************************************
+//
+//! DDRAM address of the first column of a row
+//!
+//! \param y: row
+//!
+//! This function
+//!    1. Gives 0x00/0x40 for the rows 0-1 and, on a single controller, puts
+//!		  the rows 2-3 right after them on the same lines, at 0x00/0x40
+//!		  plus the number of columns (0x14/0x54 on a 20x4, 0x10/0x50 on a
+//!		  16x4)
+//!    2. Gives the lines of the second controller, with bit 7 set, to the
+//!		  rows 2-3 of a module with two controllers
+//!
+//! \return the address, bit 7 is the controller
+//
+//****************************************************************************
+static unsigned char Lcd_row_offset(unsigned char y) {
+	if (_lcd->dual)
+		return ((y & 2) << 6) | ((y & 1) << 6);
+	return ((y & 1) << 6) | ((y & 2) ? _lcd->cols : 0);
+}
+
+//****************************************************************************
+//
+//! Find the screen cell of a DDRAM address
+//!
+//! \param addr: DDRAM address
+//! \param x: returns the column
+//! \param y: returns the row
+//!
+//! \return 1 if the address is visible with the current display shift,
+//!		   0 otherwise
+//
+//****************************************************************************
+static int Lcd_cell_of(unsigned char addr, unsigned char *x, unsigned char *y) {
+	unsigned char pos = addr & 0x3F;
+	unsigned char row, col, off;
+	if (pos >= LCD_DDRAM_LINE)
+		return 0;
+	for (row = 0; row < _lcd->rows && row < LCD_MAX_ROWS; row++) {
+		off = Lcd_row_offset(row);
+		if ((off & 0xC0) != (addr & 0xC0))
+			continue;
+		col = (pos + 2 * LCD_DDRAM_LINE - (off & 0x3F)
+				- _lcd->shift) % LCD_DDRAM_LINE;
+		if (col < _lcd->cols) {
+			*x = col;
+			*y = row;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//****************************************************************************
+//
+//! Find the DDRAM address of a screen cell
+//!
+//! \param x: column
+//! \param y: row
+//!
+//! \return the address shown at (x,y) with the current display shift
+//
+//****************************************************************************
+static unsigned char Lcd_addr_of(unsigned char x, unsigned char y) {
+	unsigned char off = Lcd_row_offset(y);
+	return (off & 0xC0) | (((off & 0x3F) + x + _lcd->shift) % LCD_DDRAM_LINE);
+}
+
+//****************************************************************************
+//
+//! DDRAM mirror entry of an address
+//!
+//! \param addr: DDRAM address, 0x00-0x27 or 0x40-0x67, plus 0x80 for the
+//!		   second controller
+//!
+//****************************************************************************
+static unsigned short *Lcd_ddram_cell(unsigned char addr) {
+	return &_lcd->ddram[(addr >> 6) & (LCD_DDRAM_LINES - 1)]
+			[(addr & 0x3F) % LCD_DDRAM_LINE];
+}
+
+//****************************************************************************
+//
+//! Move a DDRAM address the way the HD44780 address counter does
+//!
+//! \param addr: DDRAM address
+//!
+//! \return the address after one write in the current entry mode
+//
+//****************************************************************************
+static unsigned char Lcd_ddram_next(unsigned char addr) {
+	unsigned char line = addr & 0xC0;
+	unsigned char pos = addr & 0x3F;
+	if (_lcd->entryLeft) {
+		if (++pos >= 40) {
+			pos = 0;
+			line ^= 0x40;
+		}
+	} else {
+		if (pos-- == 0) {
+			pos = 39;
+			line ^= 0x40;
+		}
+	}
+	return line | pos;
+}
+
+//****************************************************************************
+//
+//! Fill both mirrors with blanks
+//
+//****************************************************************************
+static void Lcd_mirror_blank() {
+	unsigned char line, pos;
+	memset(_lcd->fb, ' ', sizeof(_lcd->fb));
+	for (line = 0; line < LCD_DDRAM_LINES; line++)
+		for (pos = 0; pos < LCD_DDRAM_LINE; pos++)
+			_lcd->ddram[line][pos] = ' ';
+}
+
+//****************************************************************************
+//
+//! Forget what the lcd is showing, the next flush resends every cell
+//
+//****************************************************************************
+static void Lcd_mirror_invalidate() {
+	unsigned char line, pos;
+	for (line = 0; line < LCD_DDRAM_LINES; line++)
+		for (pos = 0; pos < LCD_DDRAM_LINE; pos++)
+			_lcd->ddram[line][pos] = LCD_CELL_UNKNOWN;
+}
+
+//****************************************************************************
+//
+//! Track what a byte sent to the lcd does
+//!
+//! \param value: Command or data sent
+//! \param mode: COMMAND or DATA
+//!
+//! This function
+//!    1. Follows the DDRAM address counter, entry mode and display shift
+//!    2. Keeps the RAM mirrors equal to the DDRAM contents
+//!    3. Notes the DDRAM writes for the backlight timeout, whether they come
+//!		  from a flush or straight from Lcd_Print and Lcd_message
+//
+//****************************************************************************
+static void Lcd_track(unsigned char value, unsigned char mode) {
+	unsigned char x, y;
+	if (mode == DATA) {
+		if (_lcd->hwAddr == LCD_ADDR_UNKNOWN)
+			return;
+		*Lcd_ddram_cell(_lcd->hwAddr) = value;
+		_lcd->idleActive = 1;
+		if (Lcd_cell_of(_lcd->hwAddr, &x, &y))
+			_lcd->fb[y][x] = value;
+		_lcd->hwAddr = Lcd_ddram_next(_lcd->hwAddr);
+		if (_lcd->entryShift)
+			_lcd->shift = (_lcd->shift + (_lcd->entryLeft ? 1 : LCD_DDRAM_LINE - 1))
+					% LCD_DDRAM_LINE;
+	} else if (value & LCD_SETDDRAMADDR) {
+		_lcd->hwAddr = (value & 0x7F) | (_lcd->ctrl << 7);
+		_lcd->cgram = 0;
+	} else if (value & LCD_SETCGRAMADDR) {
+		_lcd->hwAddr = LCD_ADDR_UNKNOWN;
+		_lcd->cgram = 1;
+	} else if (value & LCD_FUNCTIONSET) {
+		return;
+	} else if (value & LCD_CURSORSHIFT) {
+		if (value & LCD_DISPLAYMOVE) {
+			// the window over the DDRAM moves, the address counter does not
+			_lcd->shift = (_lcd->shift + ((value & LCD_MOVERIGHT) ?
+					LCD_DDRAM_LINE - 1 : 1)) % LCD_DDRAM_LINE;
+		} else {
+			_lcd->hwAddr = LCD_ADDR_UNKNOWN;
+		}
+	} else if (value & LCD_DISPLAYCONTROL) {
+		_lcd->displayCtl = value;
+	} else if (value & LCD_ENTRYMODESET) {
+		_lcd->entryLeft = (value & LCD_ENTRYLEFT) != 0;
+		_lcd->entryShift = (value & LCD_ENTRYSHIFTINCREMENT) != 0;
+	} else if (value & LCD_RETURNHOME) {
+		_lcd->hwAddr = _lcd->ctrl << 7;
+		_lcd->cgram = 0;
+		_lcd->shift = 0;
+	} else if (value & LCD_CLEARDISPLAY) {
+		Lcd_mirror_blank();
+		_lcd->hwAddr = _lcd->ctrl << 7;
+		_lcd->cgram = 0;
+		_lcd->shift = 0;
+		_lcd->entryLeft = 1;
+	}
+}
+
+//****************************************************************************
+//
+//! Set the DDRAM address
+//!
+//! \param addr: DDRAM address, bit 7 selects the second controller of a
+//!		   module with two
+//!
+//! This function
+//!    1. Makes the controller of the address the one receiving the data
+//!    2. Sends the address to it
+//
+//****************************************************************************
+static void Lcd_set_ddram(unsigned char addr) {
+	_lcd->ctrl = addr >> 7;
+	Lcd_send_byte(LCD_SETDDRAMADDR | (addr & 0x7F), COMMAND);
+}
+
+// When the display powers up, it is configured as follows:
+//
+// 1. Display clear
+// 2. Function set:
+//    DL = 1; 8-bit interface data
+//    N = 0; 1-line display
+//    F = 0; 5x8 dot character font
+// 3. Display on/off control:
+//    D = 0; Display off
+//    C = 0; Cursor off
+//    B = 0; Blinking off
+// 4. Entry mode set:
+//    I/D = 1; Increment by 1
+//    S = 0; No shift
+//
+
+//****************************************************************************
+//
+//! Start a non-blocking initialization
+//!
+//! \param cols is the number of cols of the display
+//! \param rows is the number of rows of the display
+//!
+//! This function
+//!    1. Sets the geometry and resets the driver state of the display, a
+//!		  display of more than 80 characters (40x4) is driven as two
+//!		  controllers, the second one enabled by E2
+//!    2. Starts the reset sequence, Lcd_init_tick sends it
+//!
+//****************************************************************************
+void Lcd_init_start(unsigned char cols, unsigned char rows) {
+	_lcd->cols = (cols > LCD_MAX_COLS) ? LCD_MAX_COLS : cols;
+	_lcd->rows = (rows > LCD_MAX_ROWS) ? LCD_MAX_ROWS : rows;
+	_lcd->dual = _lcd->cols * _lcd->rows > LCD_DDRAM_CHARS;
+	_lcd->ctrl = 0;
+	_lcd->cgram = 0;
+	if (_lcd->dual) {
+		_lcd->busyMode = DISABLE;
+		_lcd->verifyCells = 0;
+	}
+	_lcd->verifyAddr = 0;
+	_lcd->curx = 0;
+	_lcd->cury = 0;
+	memset(_lcd->glyphId, LCD_GLYPH_NONE, sizeof(_lcd->glyphId));
+	memset(_lcd->glyphUse, 0, sizeof(_lcd->glyphUse));
+	// SEE PAGE 45/46 FOR INITIALIZATION SPECIFICATION!
+	// according to data sheet, we need at least 40ms after power rises above 2.7V
+	// before sending commands.
+	_lcd->initStep = LCD_INIT_POWERUP;
+	_lcd->initWaitUs = LCD_POWERUP_US;
+}
+
+//****************************************************************************
+//
+//! Advance the initialization
+//!
+//! \param ulElapsedUs: microseconds since Lcd_init_start or the previous call
+//!
+//! This function
+//!    1. Sends every step of the reset sequence that is due, each one in a
+//!		  single burst and without waiting:
+//!		  0x3, 4.1ms, 0x3, 100us, 0x3 and 0x2 (4-bit mode), function set,
+//!		  display on, clear, its execution time from the _execUs table
+//!		  (LCD_CLEAR_US, 1.52ms by default), entry mode
+//!
+//! Example, from a 1ms timer tick:
+//!		Lcd_init_start(16, 2);
+//!		...
+//!		if (Lcd_init_tick(1000) == 0) { first frame }
+//!
+//! \return microseconds until the next step is due, 0 once the display is
+//!		   initialized. No other Lcd_ call may be made to the display before.
+//
+//****************************************************************************
+unsigned long Lcd_init_tick(unsigned long ulElapsedUs) {
+	if (_lcd->initStep == LCD_INIT_DONE)
+		return 0;
+	if (ulElapsedUs < _lcd->initWaitUs) {
+		_lcd->initWaitUs -= ulElapsedUs;
+		return _lcd->initWaitUs;
+	}
+	Lcd_burst_begin();
+	switch (_lcd->initStep++) {
+	case LCD_INIT_POWERUP:
+		//first
+		Lcd_send_command(0x03);
+		_lcd->initWaitUs = 4100;
+		break;
+	case LCD_INIT_SECOND:
+		//second
+		Lcd_send_command(0x03);
+		_lcd->initWaitUs = 100;
+		break;
+	case LCD_INIT_THIRD:
+		//third
+		Lcd_send_command(0x03);
+		//Function set
+		Lcd_send_command(LCD_RETURNHOME);
+		Lcd_send_byte(LCD_FUNCTIONSET | LCD_4BITMODE | LCD_2LINE | LCD_5x8DOTS,COMMAND);
+		Lcd_send_byte(LCD_DISPLAYCONTROL | LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF,COMMAND);
+		Lcd_send_byte(LCD_CLEARDISPLAY,COMMAND);
+		_lcd->initWaitUs = _execUs[0];
+		break;
+	case LCD_INIT_ENTRY:
+	default:
+		//Entry mode set
+		Lcd_send_byte(LCD_ENTRYMODESET|LCD_ENTRYLEFT|LCD_ENTRYSHIFTDECREMENT, COMMAND);
+		_lcd->initStep = LCD_INIT_DONE;
+		_lcd->initWaitUs = 0;
+		break;
+	}
+	Lcd_burst_end();
+	return _lcd->initWaitUs;
+}
+
+//****************************************************************************
+//
+//! Initialize the LCD
+//!
+//! \param cols is the number of cols of the display
+//! \param rows is the number of cols of the display
+//!
+//! This function
+//!    1. Initialize the LCD, running the Lcd_init_tick steps with the
+//!		  datasheet minimum waits between them
+//!
+//
+//****************************************************************************
+
+void Lcd_init(unsigned char cols, unsigned char rows) {
+	unsigned long us = 0;
+	LCD_STAT_ENTER();
+	Lcd_init_start(cols, rows);
+	Lcd_burst_begin();
+	while ((us = Lcd_init_tick(us)) != 0) {
+		// the busy flag can be read once the lcd is in 4-bit mode
+		if (_lcd->initStep > LCD_INIT_THIRD)
+			Lcd_wait_ready(us);
+		else
+			Lcd_delay_us(us);
+	}
+	Lcd_burst_end();
+	LCD_STAT_EXIT(LCD_STAT_INIT);
+}
+
+//****************************************************************************
+//
+//! Take a snapshot of the driver state
+//!
+//! This function
+//!    1. Packs the geometry, backlight, entry mode, display control (on,
+//!		  cursor and blink), display shift, cursor position and busy flag
+//!		  mode of the selected display into a word small enough for a
+//!		  retained hibernate register
+//!
+//! Example, before entering hibernate:
+//!		MAP_PRCMOCRRegisterWrite(0, Lcd_snapshot());
+//!
+//! \return snapshot for Lcd_resume
+//
+//****************************************************************************
+unsigned long Lcd_snapshot() {
+	unsigned char x = (_lcd->curx > 63) ? 63 : _lcd->curx;
+	// all 32 bits are used, rows 1-4 are stored as 0-3
+	return ((unsigned long)LCD_SNAPSHOT_MAGIC << 29)
+			| ((unsigned long)(_lcd->busyMode == ENABLE) << 28)
+			| ((unsigned long)(_lcd->backlightval != 0) << 27)
+			| ((unsigned long)_lcd->entryLeft << 26)
+			| ((unsigned long)_lcd->entryShift << 25)
+			| ((unsigned long)(_lcd->displayCtl & 0x07) << 22)
+			| ((unsigned long)_lcd->shift << 16)
+			| ((unsigned long)x << 10)
+			| ((unsigned long)(_lcd->cury & 0x03) << 8)
+			| ((unsigned long)((_lcd->rows - 1) & 0x03) << 6)
+			| (_lcd->cols & 0x3F);
+}
+
+//****************************************************************************
+//
+//! Resume a display that stayed powered
+//!
+//! \param ulSnapshot: Lcd_snapshot taken before the CC3200 hibernated
+//!
+//! This function
+//!    1. Restores the driver state of the selected display without sending
+//!		  anything, the lcd kept its configuration and DDRAM
+//!    2. Marks the DDRAM and CGRAM contents unknown, the first flush resends
+//!		  the whole screen and glyphs are uploaded again when used
+//!
+//! Example, after waking up:
+//!		if (Lcd_resume(MAP_PRCMOCRRegisterRead(0)) != SUCCESS)
+//!			Lcd_init(16, 2);
+//!
+//! \Note: the framebuffer is not kept either and starts blank. In
+//!		   framebuffer mode the caller must redraw the whole screen before the
+//!		   first Lcd_flush or Lcd_service, which otherwise blanks the text
+//!		   the lcd kept. Direct writes only change the cells they write.
+//!
+//! \return failure when the snapshot is not valid, success otherwise
+//
+//****************************************************************************
+int Lcd_resume(unsigned long ulSnapshot) {
+	unsigned char cols = ulSnapshot & 0x3F;
+	unsigned char rows = ((ulSnapshot >> 6) & 0x03) + 1;
+
+	if ((ulSnapshot >> 29) != LCD_SNAPSHOT_MAGIC || cols == 0
+			|| cols > LCD_MAX_COLS || rows > LCD_MAX_ROWS)
+		return FAILURE;
+	_lcd->cols = cols;
+	_lcd->rows = rows;
+	_lcd->cury = (ulSnapshot >> 8) & 0x03;
+	_lcd->curx = (ulSnapshot >> 10) & 0x3F;
+	_lcd->shift = ((ulSnapshot >> 16) & 0x3F) % LCD_DDRAM_LINE;
+	_lcd->displayCtl = LCD_DISPLAYCONTROL | ((ulSnapshot >> 22) & 0x07);
+	_lcd->entryShift = (ulSnapshot >> 25) & 0x01;
+	_lcd->entryLeft = (ulSnapshot >> 26) & 0x01;
+	_lcd->backlightval = ((ulSnapshot >> 27) & 0x01) ? LCD_BACKLIGHT : 0;
+	_lcd->dual = cols * rows > LCD_DDRAM_CHARS;
+	_lcd->ctrl = 0;
+	_lcd->cgram = 0;
+	_lcd->busyMode = ((ulSnapshot >> 28) & 0x01) && !_lcd->dual ?
+			ENABLE : DISABLE;
+	if (_lcd->dual)
+		_lcd->verifyCells = 0;
+	_lcd->verifyAddr = 0;
+	_lcd->initStep = LCD_INIT_DONE;
+	_lcd->hwAddr = LCD_ADDR_UNKNOWN;
+	_lcd->expState = 0xFF;
+	memset(_lcd->fb, ' ', sizeof(_lcd->fb));
+	Lcd_mirror_invalidate();
+	memset(_lcd->glyphId, LCD_GLYPH_NONE, sizeof(_lcd->glyphId));
+	memset(_lcd->glyphUse, 0, sizeof(_lcd->glyphUse));
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Open a display
+//!
+//! \param pLcd: handle, owned by the application for as long as the display
+//!		   is used
+//! \param ucAddr: PCF8574T address, 0x20-0x27 (0x38-0x3F for a PCF8574AT)
+//!
+//! This function
+//!    1. Resets the handle and adds it to the displays served by the bus
+//!		  scheduler
+//!    2. Selects it, Lcd_init should follow
+//!
+//! \return failure when LCD_MAX_DEVICES displays are already open or a call
+//!		   is inside a burst, success otherwise
+//
+//****************************************************************************
+int Lcd_open(tLcd *pLcd, unsigned char ucAddr) {
+	unsigned char i;
+
+	if (_burstDepth)
+		return FAILURE;
+	for (i = 0; i < _deviceCount; i++) {
+		if (_devices[i] == pLcd)
+			break;
+	}
+	if (i == _deviceCount) {
+		if (_deviceCount == LCD_MAX_DEVICES)
+			return FAILURE;
+		_devices[_deviceCount++] = pLcd;
+	} else if (pLcd->qTail != pLcd->qHead || pLcd->qWaitUs) {
+		// still being sent
+		return FAILURE;
+	}
+	memset(pLcd, 0, sizeof(*pLcd));
+	pLcd->addr = ucAddr;
+	pLcd->hwAddr = LCD_ADDR_UNKNOWN;
+	pLcd->entryLeft = 1;
+	pLcd->expState = 0xFF;
+	_lcd = pLcd;
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Select a display
+//!
+//! \param pLcd: handle opened with Lcd_open, NULL selects the default
+//!		   display at LCDI2C_ADDRESS
+//!
+//! This function
+//!    1. Makes every following Lcd_ call act on the display
+//!
+//! \return failure inside a burst, success otherwise
+//
+//****************************************************************************
+int Lcd_select(tLcd *pLcd) {
+	if (_burstDepth)
+		return FAILURE;
+	_lcd = (pLcd != NULL) ? pLcd : &_lcdDefault;
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Get the selected display
+//!
+//! \return handle of the selected display, Lcd_select takes it back
+//
+//****************************************************************************
+tLcd *Lcd_selected() {
+	return _lcd;
+}
+
+//****************************************************************************
+//
+//! Send an instruction and wait for it
+//!
+//! \param value: instruction
+//!
+//! This function
+//!    1. Looks the execution time up in the _execUs table
+//!    2. Waits only for the long instructions, the bus takes longer than
+//!		  the others need
+//
+//****************************************************************************
+static void Lcd_command(unsigned char value) {
+	unsigned char bit = 7;
+	while (bit > 0 && !(value & (1 << bit)))
+		bit--;
+	Lcd_send_byte(value,COMMAND);
+	if (_execUs[bit] > LCD_EXEC_US)
+		Lcd_wait_ready(_execUs[bit]);
+}
+
+//****************************************************************************
+//
+//! Clear the lcd by overwriting
+//!
+//! This function
+//!    1. Counts the expander states needed to blank the non blank cells of
+//!		  the DDRAM mirror and to set the address back to 0
+//!    2. Sends them if that takes less bus time than the clear command and
+//!		  its 1.52ms. A cell takes 4 states, 8 when it needs an address, and
+//!		  the 1.52ms are worth 16 states at 100kHz and 67 at 400kHz, so only
+//!		  up to 2 contiguous cells are overwritten at 100kHz and up to 15 at
+//!		  400kHz (Lcd_bus_speed)
+//!
+//! \return success if the lcd was cleared, failure when the clear command
+//!		   is needed: a cell is unknown, the display is shifted or the entry
+//!		   mode is not left to right without shift
+//
+//****************************************************************************
+static int Lcd_soft_clear() {
+	unsigned long ulStates = 4;		// the final DDRAM address
+	unsigned long ulClear;
+	unsigned short cell;
+	unsigned char line, pos, addr;
+	unsigned char next = LCD_ADDR_UNKNOWN;
+
+	if (_lcd->hardClear || _lcd->shift || !_lcd->entryLeft || _lcd->entryShift)
+		return FAILURE;
+	for (line = 0; line < (_lcd->dual ? 4 : 2); line++) {
+		for (pos = 0; pos < LCD_DDRAM_LINE; pos++) {
+			cell = _lcd->ddram[line][pos];
+			if (cell == LCD_CELL_UNKNOWN)
+				return FAILURE;
+			if (cell == ' ')
+				continue;
+			addr = (line << 6) | pos;
+			ulStates += (addr == next) ? 4 : 8;
+			next = addr + 1;
+		}
+	}
+	// the clear command plus its execution time in states on the bus
+	ulClear = 4 + LCD_CLEAR_US * (_busHz / 1000) / 9000;
+	if (ulStates >= ulClear)
+		return FAILURE;
+	Lcd_burst_begin();
+	for (line = 0; line < (_lcd->dual ? 4 : 2); line++) {
+		for (pos = 0; pos < LCD_DDRAM_LINE; pos++) {
+			if (_lcd->ddram[line][pos] == ' ')
+				continue;
+			addr = (line << 6) | pos;
+			if (_lcd->hwAddr != addr)
+				Lcd_set_ddram(addr);
+			Lcd_send_byte(' ',DATA);
+		}
+	}
+	Lcd_set_ddram(0);
+	Lcd_burst_end();
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Clear the lcd
+//!
+//! \param None
+//!
+//! This function
+//!    1. Clears the lcd screen, overwriting the non blank cells when that
+//!		  is faster than the clear command (see Lcd_softclear)
+//!
+//! \Note: in framebuffer mode only the RAM mirror is blanked, Lcd_flush
+//!		   sends the blanks.
+//!
+//****************************************************************************
+
+void Lcd_clear() {
+	LCD_STAT_ENTER();
+	_lcd->curx = 0;
+	_lcd->cury = 0;
+	if (_lcd->fbMode == ENABLE) {
+		memset(_lcd->fb, ' ', sizeof(_lcd->fb));
+	} else if (Lcd_soft_clear() != SUCCESS) {
+		Lcd_command(LCD_CLEARDISPLAY); // clear display, set cursor position to zero
+	}
+	LCD_STAT_EXIT(LCD_STAT_CLEAR);
+}
+
+//****************************************************************************
+//
+//! Lcd home
+//!
+//! \param None
+//!
+//! This function
+//!    1. Sets the lcd into the (0,0) position, with a DDRAM address
+//!		  instead of the 1.52ms return home when the display is not shifted
+//!
+//****************************************************************************
+
+void Lcd_home() {
+	LCD_STAT_ENTER();
+	_lcd->curx = 0;
+	_lcd->cury = 0;
+	if (_lcd->fbMode != ENABLE) {
+		// without a display shift home only moves the address counter
+		if (_lcd->hardClear || _lcd->shift)
+			Lcd_command(LCD_RETURNHOME);  // set cursor position to zero
+		else if (_lcd->hwAddr != 0)
+			Lcd_set_ddram(0);
+	}
+	LCD_STAT_EXIT(LCD_STAT_HOME);
+}
+
+//****************************************************************************
+//
+//! Lcd entymode
+//!
+//! \param direction Select the direction of the lcd writing
+//! 		Flags: LCD_ENTRYRIGHT, LCD_ENTRYLEFT
+//! \param shiftdirection Select the shifting direction of the lcd
+//! 		Flags: LCD_ENTRYSHIFTINCREMENT, LCD_ENTRYSHIFTDECREMENT
+//!
+//! This function
+//!    1. Sets the lcd Entry mode
+//!
+//****************************************************************************
+void Lcd_entymode(unsigned char direction, unsigned char shiftdirection) {
+	Lcd_command(LCD_ENTRYMODESET|direction|shiftdirection);
+}
+
+
+//****************************************************************************
+//
+//! Lcd Display Control
+//!
+//! \param display Turns the display on or off
+//! 		Flags: LCD_DISPLAYON, LCD_DISPLAYOFF
+//! \param cursor Turns the cursor on or off
+//! 		Flags: LCD_CURSORON, LCD_CURSOROFF
+//! \param blink Turns the blink on or off
+//! 		Flags: LCD_BLINKON, LCD_BLINKOFF
+//! This function
+//!    1. Controls the lcd display
+//!
+//****************************************************************************
+void Lcd_displaycontrol(unsigned char display, unsigned char cursor, unsigned char blink) {
+	Lcd_command(LCD_DISPLAYCONTROL|display|cursor|blink);
+}
+
+//****************************************************************************
+//
+//! Lcd cursor shift
+//!
+//! \param move Move the display or the cursor
+//! 		Flags: LCD_DISPLAYMOVE, LCD_CURSORMOVE
+//! \param direction the direction of the shift
+//! 		Flags: LCD_MOVERIGHT, LCD_MOVELEFT
+//! This function
+//!    1. Shifts the cursor or the display
+//!
+//****************************************************************************
+void Lcd_cursorshift(unsigned char move, unsigned char direction) {
+	Lcd_command(LCD_CURSORSHIFT|move|direction);
+}
+
+//****************************************************************************
+//
+//! Lcd (x,y) position
+//!
+//!			**************************
+//!			**(0,0)			  (15,0)**
+//!			**(0,1)			  (15,1)**
+//!			**************************
+//!
+//! \param xCoor: Horizontal coordinate, starts in 0
+//! \param yCoor: Vertical coordinate, starts in 0
+//! This function
+//!    1. Sets the cursor in the desired coordinate
+//!
+//! \Note: in framebuffer mode only the text position is moved, nothing is
+//!		   sent to the lcd. The coordinates are screen positions, also while
+//!		   the display is shifted. Coordinates past the screen are clamped to
+//!		   the last column and row, before Lcd_init the call does nothing.
+//!
+//****************************************************************************
+void Lcd_gotoxy(unsigned char xCoor, unsigned char yCoor) {
+	if (_lcd->cols == 0 || _lcd->rows == 0)
+		return;
+	if (xCoor >= _lcd->cols)
+		xCoor = _lcd->cols - 1;
+	if (yCoor >= _lcd->rows) {
+		yCoor = _lcd->rows - 1;    // we count rows starting w/0
+	}
+	LCD_STAT_ENTER();
+	_lcd->curx = xCoor;
+	_lcd->cury = yCoor;
+	if (_lcd->fbMode != ENABLE)
+		Lcd_set_ddram(Lcd_addr_of(xCoor, yCoor));
+	LCD_STAT_EXIT(LCD_STAT_GOTOXY);
+}
+
+//****************************************************************************
+//
+//! Lcd wrap mode
+//!
+//! \param value: wrap flag
+//! 		Flags: ENABLE, DISABLE
+//!
+//! This function
+//!    1. Enables or disables (the default) the wrap. While enabled text
+//!		  reaching the end of a row continues at the start of the next one,
+//!		  the last row continues on the first. While disabled it goes on into
+//!		  the DDRAM past the row, or is cut in framebuffer mode.
+//!
+//! \Note: Lcd_Print prints at most the rest of the screen, limited by its
+//!		   buffer of LCD_MAX_COLS * LCD_UTF8_MAX bytes.
+//!
+//****************************************************************************
+void Lcd_wrap(unsigned char value) {
+	_lcd->wrap = (value == ENABLE) ? ENABLE : DISABLE;
+}
+
+//****************************************************************************
+//
+//! Move the text position to the start of the next row
+//!
+//! This function
+//!    1. Sets the DDRAM address of the row only when the address counter is
+//!		  not already there, as after a 40 column row or row 0 to row 2 of
+//!		  a 20x4
+//
+//****************************************************************************
+static void Lcd_wrap_row() {
+	unsigned char addr;
+	_lcd->curx = 0;
+	_lcd->cury = (_lcd->cury + 1) % _lcd->rows;
+	if (_lcd->fbMode != ENABLE) {
+		addr = Lcd_addr_of(0, _lcd->cury);
+		if (_lcd->hwAddr != addr)
+			Lcd_set_ddram(addr);
+	}
+}
+
+//****************************************************************************
+//
+//! Put the visible part of a marquee row into the RAM mirror
+//!
+//! \param row: marquee row
+//!
+//****************************************************************************
+static void Lcd_marquee_fill(unsigned char row) {
+	const char *pcText = _lcd->marquee[row];
+	unsigned short len = _lcd->marqueeLen[row];
+	unsigned short pos = _lcd->marqueePos[row];
+	unsigned char x;
+
+	for (x = 0; x < _lcd->cols; x++) {
+		_lcd->fb[row][x] = pcText[pos];
+		if (++pos == len)
+			pos = 0;
+	}
+}
+
+//****************************************************************************
+//
+//! Scroll a row
+//!
+//! \param row: row, starts in 0
+//! \param pcText: text scrolled in a loop, it must stay valid while the
+//!		   row scrolls. NULL or "" stops scrolling and leaves the row static.
+//!
+//! This function
+//!    1. Writes the text into the row, and the part that comes next into
+//!		  the DDRAM positions of the line that are out of view, so the
+//!		  following Lcd_marquee_step calls only shift the display
+//!
+//! Example:
+//!		Lcd_marquee(1, "Lux 1234  Temp 23.5C  Hum 87%  ");
+//!		while (1) { Lcd_marquee_step(); MS_DELAY(300); }
+//!
+//! \return failure for a row out of the display, LCD_QUEUE_FULL when the
+//!		   text did not fit in the queue, success otherwise
+//
+//****************************************************************************
+int Lcd_marquee(unsigned char row, const char *pcText) {
+	unsigned char x, y, i, addr, c;
+	unsigned short pos;
+
+	if (row >= _lcd->rows)
+		return FAILURE;
+	if (pcText == NULL || *pcText == '\0') {
+		_lcd->marquee[row] = NULL;
+		return SUCCESS;
+	}
+	_lcd->marquee[row] = pcText;
+	_lcd->marqueeLen[row] = strlen(pcText);
+	_lcd->marqueePos[row] = 0;
+
+	Lcd_burst_begin();
+	pos = _lcd->cols % _lcd->marqueeLen[row];
+	for (i = _lcd->cols; i < LCD_DDRAM_LINE; i++) {
+		c = pcText[pos];
+		if (++pos == _lcd->marqueeLen[row])
+			pos = 0;
+		// on a 4 row display the rest of the line is the row below
+		addr = Lcd_addr_of(i, row);
+		if (Lcd_cell_of(addr, &x, &y) || *Lcd_ddram_cell(addr) == c)
+			continue;
+		if (_lcd->hwAddr != addr)
+			Lcd_set_ddram(addr);
+		Lcd_send_byte(c, DATA);
+	}
+	Lcd_marquee_fill(row);
+	Lcd_flush();
+	return Lcd_burst_end();
+}
+
+//****************************************************************************
+//
+//! Scroll the marquee rows one position
+//!
+//! This function
+//!    1. Shifts the display left, which moves every row, so the marquee
+//!		  rows only need the positions that wrap back into view
+//!    2. Rewrites the static rows at the shifted positions so they stay
+//!		  where they were, and sends any other Lcd_flush work with them
+//!
+//! \Note: the cost of a step grows with the static rows, one shift command
+//!		   when every row scrolls and a whole row for each static one.
+//!		   Lcd_clear and Lcd_home undo the shift, the marquee rows keep
+//!		   scrolling from the next step.
+//!
+//! \return LCD_QUEUE_FULL when the step did not fit in the queue, success
+//!		   otherwise
+//
+//****************************************************************************
+int Lcd_marquee_step() {
+	unsigned char row;
+	int iRet;
+
+	for (row = 0; row < _lcd->rows; row++) {
+		if (_lcd->marquee[row] != NULL)
+			break;
+	}
+	if (row == _lcd->rows)
+		return SUCCESS;
+
+	Lcd_burst_begin();
+	Lcd_send_byte(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVELEFT, COMMAND);
+	for (row = 0; row < _lcd->rows; row++) {
+		if (_lcd->marquee[row] == NULL)
+			continue;
+		if (++_lcd->marqueePos[row] == _lcd->marqueeLen[row])
+			_lcd->marqueePos[row] = 0;
+		Lcd_marquee_fill(row);
+	}
+	iRet = Lcd_flush();
+	if (Lcd_burst_end() == LCD_QUEUE_FULL)
+		return LCD_QUEUE_FULL;
+	return iRet;
+}
+
+//****************************************************************************
+//
+//! Fill the first 8 CGRAM locations with custom characters
+//!
+//! Examples;
+//!		unsigned char bell[8]	 = 	{0x0, 0xa, 0x1f, 0x1f, 0xe, 0x4, 0x0};
+//!		unsigned char note[8]  	= 	{0x2, 0x3, 0x2, 0xe, 0x1e, 0xc, 0x0};
+//!		unsigned char clock[8] 	= 	{0x0, 0xe, 0x15, 0x17, 0x11, 0xe, 0x0};
+//!		unsigned char heart[8] 	= 	{0x0, 0xa, 0x1f, 0x1f, 0xe, 0x4, 0x0};
+//!		unsigned char duck[8]  	= 	{0x0, 0xc, 0x1d, 0xf, 0xf, 0x6, 0x0};
+//!		unsigned char check[8] 	= 	{0x0, 0x1, 0x3, 0x16, 0x1c, 0x8, 0x0};
+//!		unsigned char cross[8] 	= 	{0x0, 0x1b, 0xe, 0x4, 0xe, 0x1b, 0x0};
+//!		unsigned char retarrow[8] = {0x1, 0x1, 0x5, 0x9, 0x1f, 0x8, 0x4};
+//!
+//!		Lcd_createChar(0, bell);
+//!		Lcd_createChar(1, note); so on...
+//!
+//!		To print the character:
+//!		Lcd_send_byte(0,DATA);	//Prints bell character
+//!		Lcd_send_byte(1,DATA); 	//Prints note character and so on...
+//!
+//! \param location: Location of the character (0-7)
+//! \param charmap[]: Map of the custom character
+//! This function
+//!    1. Sends the custom character to the lcd CGRAM
+//!    2. Takes the location out of the glyph cache until the next Lcd_init
+//!
+//****************************************************************************
+void Lcd_createChar(unsigned char location, unsigned char charmap[]) {
+	location &= 0x7; // we only have 8 locations 0-7
+	_lcd->glyphId[location] = LCD_GLYPH_USER;
+	LCD_STAT_ENTER();
+	Lcd_burst_begin();
+	Lcd_send_byte(LCD_SETCGRAMADDR | (location << 3),COMMAND);
+	Lcd_send_data(charmap, 8);
+	Lcd_burst_end();
+	LCD_STAT_EXIT(LCD_STAT_CREATECHAR);
+}
+
+
+//****************************************************************************
+//
+//! Set the glyph table
+//!
+//! \param pucTable: 5x8 bitmaps in the Lcd_createChar format, the glyph ID is
+//!		   the index in the table. It must stay valid while glyphs are used.
+//! \param ucCount: number of glyphs, up to LCD_GLYPH_MAX
+//!
+//! Example:
+//!		static const unsigned char icons[][8] = { {bell}, {note}, ... };
+//!		int iBell;
+//!		Lcd_glyph_table(icons, 12);
+//!		iBell = Lcd_glyph(ICON_BELL);
+//!		Lcd_Print("%c", (iBell < 0) ? '*' : iBell);
+//!
+//! \Note: Lcd_glyph returns a negative error when the upload fails, check it
+//!		   before printing, as a character it would show garbage.
+//!
+//****************************************************************************
+void Lcd_glyph_table(const unsigned char (*pucTable)[8], unsigned char ucCount) {
+	_glyphTable = pucTable;
+	_glyphCount = (ucCount > LCD_GLYPH_MAX) ? LCD_GLYPH_MAX : ucCount;
+}
+
+//****************************************************************************
+//
+//! Load glyphs into CGRAM
+//!
+//! \param pucIds: glyph IDs, usually every glyph a screen shows
+//! \param ucCount: number of IDs, up to 8 minus the locations written with
+//!		   Lcd_createChar
+//!
+//! This function
+//!    1. Leaves the glyphs already in CGRAM where they are
+//!    2. Gives each missing glyph the least recently used free location
+//!    3. Uploads locations that follow each other after a single CGRAM
+//!		  address, the address counter does the rest
+//!    4. Moves the address counter back to the DDRAM address it had
+//!
+//! \Note: characters on screen that show a replaced location change with it.
+//!
+//! \return LCD_QUEUE_FULL when the upload did not fit in the queue, failure
+//!		   for an unknown ID or too many IDs, which leaves the cache as it
+//!		   was, success otherwise
+//
+//****************************************************************************
+int Lcd_glyph_load(const unsigned char *pucIds, unsigned char ucCount) {
+	unsigned char aucPlan[LCD_GLYPH_SLOTS];
+	unsigned char ucKeep = 0;
+	unsigned char ucUpload = 0;
+	unsigned char ucAddr = _lcd->hwAddr;
+	unsigned char i, slot, victim;
+	int iRet;
+
+	for (i = 0; i < ucCount; i++) {
+		if (_glyphTable == NULL || pucIds[i] >= _glyphCount)
+			return FAILURE;
+	}
+	// the glyphs already loaded must not be replaced by the others
+	for (i = 0; i < ucCount; i++) {
+		for (slot = 0; slot < LCD_GLYPH_SLOTS; slot++) {
+			if (_lcd->glyphId[slot] == pucIds[i])
+				ucKeep |= 1 << slot;
+		}
+	}
+	// plan the locations first, the cache is left as it was on failure
+	memcpy(aucPlan, _lcd->glyphId, sizeof(aucPlan));
+	for (i = 0; i < ucCount; i++) {
+		victim = LCD_GLYPH_SLOTS;
+		for (slot = 0; slot < LCD_GLYPH_SLOTS; slot++) {
+			if (aucPlan[slot] == pucIds[i])
+				break;
+			if ((ucKeep & (1 << slot)) || aucPlan[slot] == LCD_GLYPH_USER)
+				continue;
+			if (victim == LCD_GLYPH_SLOTS
+					|| _lcd->glyphUse[slot] < _lcd->glyphUse[victim])
+				victim = slot;
+		}
+		if (slot < LCD_GLYPH_SLOTS)
+			continue;
+		if (victim == LCD_GLYPH_SLOTS)
+			return FAILURE;
+		aucPlan[victim] = pucIds[i];
+		ucKeep |= 1 << victim;
+		ucUpload |= 1 << victim;
+	}
+	for (slot = 0; slot < LCD_GLYPH_SLOTS; slot++) {
+		if (ucKeep & (1 << slot)) {
+			_lcd->glyphId[slot] = aucPlan[slot];
+			_lcd->glyphUse[slot] = ++_lcd->glyphClock;
+		}
+	}
+	if (ucUpload == 0)
+		return SUCCESS;
+
+	Lcd_burst_begin();
+	for (slot = 0; slot < LCD_GLYPH_SLOTS; slot++) {
+		if (!(ucUpload & (1 << slot)))
+			continue;
+		if (slot == 0 || !(ucUpload & (1 << (slot - 1))))
+			Lcd_send_byte(LCD_SETCGRAMADDR | (slot << 3), COMMAND);
+		Lcd_send_data(_glyphTable[_lcd->glyphId[slot]], 8);
+	}
+	if (ucAddr != LCD_ADDR_UNKNOWN)
+		Lcd_set_ddram(ucAddr);
+	iRet = Lcd_burst_end();
+	if (iRet == LCD_QUEUE_FULL) {
+		// nothing was sent, the locations hold unknown glyphs
+		for (slot = 0; slot < LCD_GLYPH_SLOTS; slot++) {
+			if (ucUpload & (1 << slot)) {
+				_lcd->glyphId[slot] = LCD_GLYPH_NONE;
+				_lcd->glyphUse[slot] = 0;
+			}
+		}
+	}
+	return iRet;
+}
+
+//****************************************************************************
+//
+//! Get the character code of a glyph
+//!
+//! \param ucId: glyph ID
+//!
+//! This function
+//!    1. Loads the glyph with Lcd_glyph_load if it is not in CGRAM
+//!    2. Marks it as the most recently used
+//!
+//! \return the character code to print, 0x08-0x0F (the lcd repeats CGRAM
+//!		   0-7 there, so it is never the string terminator), or the
+//!		   Lcd_glyph_load error
+//
+//****************************************************************************
+int Lcd_glyph(unsigned char ucId) {
+	unsigned char slot;
+	int iRet = Lcd_glyph_load(&ucId, 1);
+
+	if (iRet != SUCCESS)
+		return iRet;
+	for (slot = 0; slot < LCD_GLYPH_SLOTS; slot++) {
+		if (_lcd->glyphId[slot] == ucId)
+			break;
+	}
+	return LCD_GLYPH_SLOTS + slot;
+}
+
+//****************************************************************************
+//
+//! Set the code points of the glyphs
+//!
+//! \param pusCodes: Unicode code point of every glyph of the Lcd_glyph_table
+//!		   table, 0 for the glyphs that are not characters
+//!
+//! This function
+//!    1. Lets the UTF-8 translation print the code points missing from the
+//!		  character ROM with the glyph cache
+//!
+//! Example:
+//!		static const unsigned short codes[] = { 0x00E9, 0x00E8, 0x20AC };
+//!		Lcd_glyph_table(accents, 3);
+//!		Lcd_glyph_codes(codes);
+//!
+//****************************************************************************
+void Lcd_glyph_codes(const unsigned short *pusCodes) {
+	_glyphCodes = pusCodes;
+}
+
+//****************************************************************************
+//
+//! Select the character ROM of the lcd
+//!
+//! \param ucRom: LCD_ROM_A00 (Japanese) or LCD_ROM_A02 (European) translate
+//!		   the UTF-8 text of Lcd_message and Lcd_Print, LCD_ROM_RAW sends
+//!		   the bytes as they are
+//!
+//****************************************************************************
+void Lcd_rom(unsigned char ucRom) {
+	_lcd->rom = (ucRom <= LCD_ROM_A02) ? ucRom : LCD_ROM_RAW;
+}
+
+//****************************************************************************
+//
+//! Translate a code point
+//!
+//! \param pRom: character ROM
+//! \param ulCode: Unicode code point
+//!
+//! This function
+//!    1. Looks the code point up in the range and the table of the ROM
+//!    2. Falls back to the glyph cache, then to LCD_ROM_UNKNOWN
+//!
+//! \return character code
+//
+//****************************************************************************
+static unsigned char Lcd_rom_char(const tLcdRom *pRom, unsigned long ulCode) {
+	int iLow = 0;
+	int iHigh = pRom->ucCount - 1;
+	int iMid, iGlyph;
+	unsigned char i;
+
+	if (ulCode >= pRom->usFirst && ulCode <= pRom->usLast)
+		return pRom->ucFirstChar + (ulCode - pRom->usFirst);
+	while (iLow <= iHigh) {
+		iMid = (iLow + iHigh) >> 1;
+		if (pRom->pusCode[iMid] == ulCode)
+			return pRom->pucChar[iMid];
+		if (pRom->pusCode[iMid] < ulCode)
+			iLow = iMid + 1;
+		else
+			iHigh = iMid - 1;
+	}
+	if (_glyphCodes != NULL && ulCode != 0) {
+		for (i = 0; i < _glyphCount; i++) {
+			if (_glyphCodes[i] != ulCode)
+				continue;
+			iGlyph = Lcd_glyph(i);
+			if (iGlyph >= 0)
+				return iGlyph;
+			break;
+		}
+	}
+	return LCD_ROM_UNKNOWN;
+}
+
+//****************************************************************************
+//
+//! Translate UTF-8 text
+//!
+//! \param ppcText: text, moved past the characters translated
+//! \param pucOut: returns the character codes
+//! \param uiMax: most characters to translate
+//!
+//! This function
+//!    1. Copies ASCII straight through, a bitmap test per character
+//!    2. Decodes the multi-byte sequences and translates their code points,
+//!		  a malformed sequence becomes one LCD_ROM_UNKNOWN
+//!
+//! \return number of character codes
+//
+//****************************************************************************
+static unsigned int Lcd_utf8(const char **ppcText, unsigned char *pucOut,
+		unsigned int uiMax) {
+	const tLcdRom *pRom = &_roms[_lcd->rom - LCD_ROM_A00];
+	const unsigned char *pucIn = (const unsigned char *)*ppcText;
+	unsigned int uiLen = 0;
+	unsigned long ulCode;
+	unsigned char c, ucBytes;
+
+	while (uiLen < uiMax && (c = *pucIn) != '\0') {
+		pucIn++;
+		if (c < 0x80) {
+			pucOut[uiLen++] = (pRom->pucAscii[c >> 3] & (1 << (c & 7))) ?
+					LCD_ROM_UNKNOWN : c;
+			continue;
+		}
+		ucBytes = _utf8Len[c >> 3];
+		ulCode = c & (0x7F >> ucBytes);
+		for (; ucBytes > 1; ucBytes--) {
+			if ((*pucIn & 0xC0) != 0x80)
+				break;
+			ulCode = (ulCode << 6) | (*pucIn++ & 0x3F);
+		}
+		// 1 when every continuation byte was there
+		pucOut[uiLen++] = (ucBytes != 1) ? LCD_ROM_UNKNOWN
+				: Lcd_rom_char(pRom, ulCode);
+	}
+	*ppcText = (const char *)pucIn;
+	return uiLen;
+}
+
+//****************************************************************************
+//
+//! Sends char by char the data string
+//!
+//! \param str: string pointer
+//! This function
+//!    1. Sends char by char the data string,
+//!		  stops until it finds the NULL character
+//!    2. With Lcd_rom set, decodes the string as UTF-8 and sends the ROM
+//!		  character of every code point, or its glyph from the cache
+//!
+//! \Note: a string needing more than 8 glyphs at once shows the first ones
+//!		   replaced by the last ones.
+//!
+//****************************************************************************
+
+void Lcd_message(const char *str)
+{
+    if(str != NULL)
+    {
+        LCD_STAT_ENTER();
+        if(_lcd->rom != LCD_ROM_RAW)
+        {
+            Lcd_message_rom(str, (unsigned int)-1);
+        }
+        else if(_lcd->fbMode == ENABLE)
+        {
+            while(*str!='\0')
+            {
+            	Lcd_putc(*str++);
+            }
+        }
+        else
+        {
+            unsigned int uiLen = strlen(str);
+            unsigned int uiChunk;
+            Lcd_burst_begin();
+            while(uiLen > 0)
+            {
+                uiChunk = uiLen;
+                if(_lcd->wrap == ENABLE)
+                {
+                    // one row at a time
+                    if(_lcd->curx >= _lcd->cols)
+                        Lcd_wrap_row();
+                    if(uiChunk > (unsigned int)(_lcd->cols - _lcd->curx))
+                        uiChunk = _lcd->cols - _lcd->curx;
+                }
+                Lcd_send_data((const unsigned char *)str, uiChunk);
+                _lcd->curx += uiChunk;
+                str += uiChunk;
+                uiLen -= uiChunk;
+            }
+            Lcd_burst_end();
+        }
+        LCD_STAT_EXIT(LCD_STAT_MESSAGE);
+    }
+}
+
+//****************************************************************************
+//
+//! Send UTF-8 text
+//!
+//! \param str: string pointer
+//! \param uiCols: most characters to print
+//!
+//! This function
+//!    1. Translates the text a row at a time and sends it, or puts it into
+//!		  the RAM mirror in framebuffer mode
+//!
+//! \return number of characters printed
+//
+//****************************************************************************
+static unsigned int Lcd_message_rom(const char *str, unsigned int uiCols) {
+	unsigned char aucOut[LCD_MAX_COLS];
+	unsigned int uiLen, i;
+	unsigned int uiCount = 0;
+
+	Lcd_burst_begin();
+	while (uiCols > 0 && *str != '\0') {
+		uiLen = (uiCols < LCD_MAX_COLS) ? uiCols : LCD_MAX_COLS;
+		if (_lcd->wrap == ENABLE) {
+			if (_lcd->curx >= _lcd->cols)
+				Lcd_wrap_row();
+			if (uiLen > (unsigned int)(_lcd->cols - _lcd->curx))
+				uiLen = _lcd->cols - _lcd->curx;
+		}
+		uiLen = Lcd_utf8(&str, aucOut, uiLen);
+		uiCols -= uiLen;
+		uiCount += uiLen;
+		if (_lcd->fbMode == ENABLE) {
+			for (i = 0; i < uiLen; i++)
+				Lcd_putc(aucOut[i]);
+		} else {
+			Lcd_send_data(aucOut, uiLen);
+			_lcd->curx += uiLen;
+		}
+	}
+	Lcd_burst_end();
+	return uiCount;
+}
+
+//****************************************************************************
+//
+//! Put a character at the text position
+//!
+//! \param c: character code, 0-7 prints the custom CGRAM characters
+//!
+//! This function
+//!    1. Writes the character into the RAM mirror of the display
+//!    2. Sends it to the lcd unless framebuffer mode is enabled
+//!    3. Advances the text position
+//!
+//****************************************************************************
+void Lcd_putc(unsigned char c) {
+	if (_lcd->wrap == ENABLE && _lcd->curx >= _lcd->cols)
+		Lcd_wrap_row();
+	if (_lcd->fbMode == ENABLE) {
+		if (_lcd->curx < _lcd->cols && _lcd->cury < _lcd->rows)
+			_lcd->fb[_lcd->cury][_lcd->curx] = c;
+	} else {
+		Lcd_send_byte(c,DATA);
+	}
+	_lcd->curx++;
+}
+
+//****************************************************************************
+//
+//! Lcd framebuffer mode
+//!
+//! \param value: framebuffer mode flag
+//! 		Flags: ENABLE, DISABLE
+//!
+//! This function
+//!    1. Enables or disables framebuffer mode. While enabled the text
+//!		  functions (Lcd_clear, Lcd_home, Lcd_gotoxy, Lcd_putc, Lcd_message
+//!		  and Lcd_Print) only update the RAM mirror of the display and
+//!		  Lcd_flush sends the cells that changed.
+//!
+//****************************************************************************
+void Lcd_framebuffer(unsigned char value) {
+	if (value != ENABLE)
+		Lcd_flush();
+	_lcd->fbMode = (value == ENABLE) ? ENABLE : DISABLE;
+}
+
+//****************************************************************************
+//
+//! Flush the framebuffer
+//!
+//! This function
+//!    1. Compares the RAM mirror with what the lcd is showing
+//!    2. Sends only the changed cells, setting the DDRAM address only when
+//!		  the next changed cell is not where the address counter already is
+//!    3. Visits the rows in DDRAM address order, so the address counter
+//!		  runs on from the end of a row into the next one: 0, 2, 1, 3 on a
+//!		  20x4, where row 2 continues line 0 and row 1 follows it at 0x40
+//!
+//! \return i2c writing failure or success, LCD_QUEUE_FULL when the
+//!		   asynchronous queue ran out of room before every cell was queued
+//
+//****************************************************************************
+int Lcd_flush() {
+	unsigned char aucOrder[LCD_MAX_ROWS];
+	unsigned char x, y, i, j, addr;
+	int iRet;
+	LCD_STAT_ENTER();
+	_flushSent = 0;
+	for (i = 0; i < _lcd->rows; i++) {
+		for (j = i; j > 0 && Lcd_row_offset(aucOrder[j - 1]) > Lcd_row_offset(i);
+				j--)
+			aucOrder[j] = aucOrder[j - 1];
+		aucOrder[j] = i;
+	}
+	Lcd_burst_begin();
+	for (i = 0; i < _lcd->rows; i++) {
+		// right to left entry goes down the addresses, last row first
+		y = aucOrder[_lcd->entryLeft ? i : _lcd->rows - 1 - i];
+		for (x = 0; x < _lcd->cols; x++) {
+			// right to left entry writes each row from its end
+			unsigned char cx = _lcd->entryLeft ? x : _lcd->cols - 1 - x;
+			addr = Lcd_addr_of(cx, y);
+			if (_lcd->fb[y][cx] == *Lcd_ddram_cell(addr))
+				continue;
+			// stop at a cell boundary when the queue is short, the next
+			// flush carries on from here
+			if (_asyncMode == ENABLE && Lcd_queue_free() < 16) {
+				Lcd_burst_end();
+				LCD_STAT_EXIT(LCD_STAT_FLUSH);
+				return LCD_QUEUE_FULL;
+			}
+			if (_lcd->hwAddr != addr)
+				Lcd_set_ddram(addr);
+			Lcd_send_byte(_lcd->fb[y][cx],DATA);
+			_flushSent++;
+		}
+	}
+	iRet = Lcd_burst_end();
+	if (_flushSent)
+		LCD_STAT_ADD(frames, 1);
+	LCD_STAT_EXIT(LCD_STAT_FLUSH);
+	return iRet;
+}
+
+//****************************************************************************
+//
+//! Begin a burst transfer
+//!
+//! This function
+//!    1. Starts collecting expander states in RAM instead of sending each
+//!		  one in its own I2C transaction
+//!
+//! \Note: the PCF8574T latches every byte received after a single address
+//!		   phase, so a whole string goes out in one start/address/stop.
+//!		   At 100kHz every byte takes 90us on the wire, well above the 37us
+//!		   the HD44780 needs per character. Calls may be nested, only the
+//!		   outermost Lcd_burst_end sends the data.
+//!
+//****************************************************************************
+void Lcd_burst_begin() {
+	if (_burstDepth++ == 0) {
+		_burstShift = _lcd->shift;
+		_burstEntry = (_lcd->entryLeft << 1) | _lcd->entryShift;
+	}
+}
+
+//****************************************************************************
+//
+//! End a burst transfer
+//!
+//! This function
+//!    1. Sends the collected expander states in a single I2C transaction
+//!
+//! \return i2c writing failure or success
+//
+//****************************************************************************
+int Lcd_burst_end() {
+	if (_burstDepth == 0)
+		return SUCCESS;
+	if (--_burstDepth > 0)
+		return SUCCESS;
+	if (_asyncMode == ENABLE)
+		return Lcd_queue_commit();
+	return Lcd_burst_flush();
+}
+
+//****************************************************************************
+//
+//! Lcd asynchronous mode
+//!
+//! \param value: asynchronous mode flag
+//! 		Flags: ENABLE, DISABLE
+//!
+//! This function
+//!    1. Enables or disables the asynchronous mode. While enabled every call
+//!		  queues its expander states and command waits instead of blocking,
+//!		  and the transmit port sends them in the background.
+//!    2. When disabling, waits until the queues of every display are empty
+//!
+//! \Note: a call that does not fit in the queue is dropped whole. Lcd_Print,
+//!		   Lcd_flush and Lcd_burst_end return LCD_QUEUE_FULL in that case,
+//!		   Lcd_queue_free tells the room left before calling.
+//!
+//****************************************************************************
+void Lcd_async(unsigned char value) {
+	if (value == ENABLE) {
+		Lcd_burst_flush();
+		_asyncMode = ENABLE;
+		return;
+	}
+	while (_qBusy || Lcd_queue_pending()) {
+		if (_port == NULL)
+			Lcd_queue_service();
+	}
+	_asyncMode = DISABLE;
+}
+
+//****************************************************************************
+//
+//! Lcd busy flag mode
+//!
+//! \param value: busy flag mode flag
+//! 		Flags: ENABLE, DISABLE
+//!
+//! This function
+//!    1. Enables or disables busy flag polling. While enabled commands
+//!		  finish as soon as the lcd reports ready, reading D7 back through
+//!		  the PCF8574T, instead of waiting their worst case time, and the
+//!		  120us guard before each I2C write is skipped.
+//!
+//! \Note: the module RW line (P1) must be wired to the lcd. The
+//!		   asynchronous mode cannot read, it keeps the timed waits. A 40x4
+//!		   uses P1 as E2 and has RW tied low, it always keeps them.
+//!
+//****************************************************************************
+void Lcd_busyflag(unsigned char value) {
+	_lcd->busyMode = (value == ENABLE && !_lcd->dual) ? ENABLE : DISABLE;
+}
+
+//****************************************************************************
+//
+//! Lcd soft clear mode
+//!
+//! \param value: soft clear flag
+//! 		Flags: ENABLE, DISABLE
+//!
+//! This function
+//!    1. Enables (the default) or disables the soft clear and home. While
+//!		  enabled Lcd_clear overwrites the few non blank cells instead of
+//!		  sending the 1.52ms clear command when that is faster, and
+//!		  Lcd_home sets the DDRAM address when the display is not shifted.
+//!
+//! \Note: disable it to clear a display whose contents may have been
+//!		   corrupted, the soft clear trusts the DDRAM mirror.
+//!
+//****************************************************************************
+void Lcd_softclear(unsigned char value) {
+	_lcd->hardClear = (value == ENABLE) ? 0 : 1;
+}
+
+//****************************************************************************
+//
+//! Set the microsecond clock
+//!
+//! \param pClock: clock source, NULL goes back to UtilsDelay cycle counts
+//!
+//! This function
+//!    1. Times every command gap against the clock, each write waits only
+//!		  for what is left of the gap since the last write to that lcd
+//!    2. Lets the long waits after clear, home and the init steps run
+//!		  while the caller works, they end before the next write
+//!
+//! \Note: Lcd_port_clock_init registers a TIMERA2 clock on the CC3200.
+//!
+//****************************************************************************
+void Lcd_clock(const tLcdClock *pClock) {
+	unsigned char i;
+	_clock = pClock;
+	for (i = 0; i < _deviceCount; i++)
+		_devices[i]->readyAt = Lcd_micros();
+}
+
+//****************************************************************************
+//
+//! Read the microsecond clock
+//!
+//! \return free running microsecond count, 0 without a clock
+//
+//****************************************************************************
+unsigned long Lcd_micros() {
+	if (_clock == NULL)
+		return 0;
+	return _clock->pfnMicros();
+}
+
+//****************************************************************************
+//
+//! Wait for a deadline
+//!
+//! \param ulDeadline: clock time, the function returns not before it
+//!
+//! This function
+//!    1. Sleeps for what is left of the wait, or spins on the clock if
+//!		  the clock has no sleep function
+//!    2. Returns at once if the deadline already passed or there is no
+//!		  clock
+//!
+//****************************************************************************
+void Lcd_wait_until(unsigned long ulDeadline) {
+	long lLeft;
+#ifdef LCD_STATS
+	unsigned long ulSleep;
+#endif
+	if (_clock == NULL)
+		return;
+#ifdef LCD_STATS
+	lLeft = (long)(ulDeadline - _clock->pfnMicros());
+	if (lLeft > 0)
+		_stats.waitUs += lLeft;
+#endif
+	while ((lLeft = (long)(ulDeadline - _clock->pfnMicros())) > 0) {
+		if (_clock->pfnSleep != NULL) {
+#ifdef LCD_STATS
+			ulSleep = _clock->pfnMicros();
+			_clock->pfnSleep((unsigned long)lLeft);
+			_stats.sleepUs += _clock->pfnMicros() - ulSleep;
+#else
+			_clock->pfnSleep((unsigned long)lLeft);
+#endif
+		}
+	}
+}
+
+//****************************************************************************
+//
+//! Check the selected lcd
+//!
+//! \return 1 if the lcd finished the last command and a write would not
+//!		   wait, 0 otherwise. Always 1 without a clock.
+//
+//****************************************************************************
+int Lcd_ready() {
+	if (_clock == NULL)
+		return 1;
+	return (long)(_lcd->readyAt - _clock->pfnMicros()) <= 0;
+}
+
+#ifdef LCD_STATS
+//****************************************************************************
+//
+//! Set the instrumentation clock
+//!
+//! \param pfnTicks: free running counter, e.g. the DWT cycle counter, NULL
+//!		   uses the driver clock of Lcd_clock
+//! \param ulTicksPerUs: counter ticks per microsecond
+//!
+//! \Note: Lcd_port_stats_init sets the DWT cycle counter on the CC3200.
+//!
+//****************************************************************************
+void Lcd_stats_clock(unsigned long (*pfnTicks)(void), unsigned long ulTicksPerUs) {
+	_statTicks = pfnTicks;
+	_statTicksPerUs = (pfnTicks != NULL && ulTicksPerUs != 0) ? ulTicksPerUs : 1;
+}
+
+//****************************************************************************
+//
+//! Read the counters
+//!
+//! \return counters and histograms since the last Lcd_stats_reset, shared
+//!		   by every display
+//
+//****************************************************************************
+const tLcdStats *Lcd_stats() {
+	return &_stats;
+}
+
+//****************************************************************************
+//
+//! Clear the counters and histograms
+//!
+//****************************************************************************
+void Lcd_stats_reset() {
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+//****************************************************************************
+//
+//! Print the counters
+//!
+//! This function
+//!    1. Prints the bus counters, then for every call made the number of
+//!		  calls, the average and worst time and the non empty histogram
+//!		  buckets, over the UART with Report
+//!
+//! Example output:
+//!		Lcd_Print  calls 40 avg 1210us max 3080us
+//!		  <1024us:12 <2048us:26 <4096us:2
+//!
+//****************************************************************************
+void Lcd_stats_dump() {
+	unsigned char i, b;
+
+	DBG_PRINT("Lcd %lu transactions %lu bytes %lu failures %luus waiting, "
+			"queue max %u\n\r", _stats.transactions, _stats.bytes,
+			_stats.failures, _stats.waitUs, _stats.queueMax);
+	DBG_PRINT("Lcd %luus active %luus asleep, %lu frames %luus active a "
+			"frame\n\r", _stats.activeUs, _stats.sleepUs, _stats.frames,
+			_stats.frames ? _stats.activeUs / _stats.frames : 0);
+	DBG_PRINT("Lcd %lu cells repaired %lu resyncs\n\r", _stats.repairs,
+			_stats.resyncs);
+	for (i = 0; i < LCD_STAT_CALLS; i++) {
+		if (_stats.calls[i] == 0)
+			continue;
+		DBG_PRINT("%s calls %lu avg %luus max %luus\n\r", _statNames[i],
+				_stats.calls[i], _stats.totalUs[i] / _stats.calls[i],
+				_stats.maxUs[i]);
+		for (b = 0; b < LCD_STAT_BUCKETS; b++) {
+			if (_stats.hist[i][b] != 0)
+				DBG_PRINT("  <%luus:%lu", 2UL << b, _stats.hist[i][b]);
+		}
+		DBG_PRINT("\n\r");
+	}
+}
+#endif
+
+#ifdef LCD_TRACE
+//****************************************************************************
+//
+//! Lcd bus trace
+//!
+//! \param value: trace flag
+//! 		Flags: ENABLE starts a new trace, DISABLE stops it and keeps
+//!			   it for Lcd_trace_dump
+//!
+//! This function
+//!    1. Records every I2C write and read with its expander states, and
+//!		  every wait for the lcd, with the microseconds between records
+//!		  when Lcd_clock is set
+//!    2. With an interrupt driven port, records the asynchronous queue as
+//!		  it is published, the states and command waits of each call
+//!
+//****************************************************************************
+void Lcd_trace(unsigned char value) {
+	if (value == ENABLE) {
+		_traceHead = 0;
+		_traceLen = 0;
+		_traceDropped = 0;
+		_traceLast = Lcd_micros();
+	}
+	_traceOn = (value == ENABLE) ? ENABLE : DISABLE;
+}
+
+//****************************************************************************
+//
+//! Copy the trace
+//!
+//! \param pucBuf: output, the records from the oldest on
+//! \param uiSize: size of pucBuf
+//!
+//! \return bytes copied, the trace is cut at uiSize
+//
+//****************************************************************************
+unsigned int Lcd_trace_read(unsigned char *pucBuf, unsigned int uiSize) {
+	unsigned int i;
+	if (uiSize > _traceLen)
+		uiSize = _traceLen;
+	for (i = 0; i < uiSize; i++)
+		pucBuf[i] = _trace[(_traceHead + i) % LCD_TRACE_SIZE];
+	return uiSize;
+}
+
+//****************************************************************************
+//
+//! Print the trace
+//!
+//! This function
+//!    1. Prints the trace in hex with Report, between a header line and an
+//!		  end line, so Host/lcd_replay can read it from a UART log
+//!
+//! Output:
+//!		LCDTRACE 1 <bus Hz> <bytes> <records dropped>
+//!		<32 bytes a line in hex>
+//!		LCDTRACE END
+//!
+//! Each record is its length as a varint, the LCD_TRACE_ type, the
+//! microseconds since the previous record as a varint, then
+//!		LCD_TRACE_WRITE: address, number of states, run-length encoded states
+//!		LCD_TRACE_READ:  address, pins
+//!		LCD_TRACE_WAIT:  microseconds as a varint
+//!
+//****************************************************************************
+void Lcd_trace_dump() {
+	unsigned int i;
+
+	DBG_PRINT("LCDTRACE 1 %lu %u %lu\n\r", _busHz, _traceLen, _traceDropped);
+	for (i = 0; i < _traceLen; i++) {
+		DBG_PRINT("%02x", _trace[(_traceHead + i) % LCD_TRACE_SIZE]);
+		if ((i & 31) == 31 || i + 1 == _traceLen)
+			DBG_PRINT("\n\r");
+	}
+	DBG_PRINT("LCDTRACE END\n\r");
+}
+#endif
+
+//****************************************************************************
+//
+//! Set the transmit port
+//!
+//! \param port: transmit port, NULL sends synchronously with I2C_IF_Write
+//!		   from Lcd_queue_service
+//!
+//****************************************************************************
+void Lcd_queue_port(const tLcdPort *port) {
+	_port = port;
+}
+
+//****************************************************************************
+//
+//! Free queue entries
+//!
+//! \return number of entries that can still be queued for the selected
+//!		   display, each character takes 8 entries and each command wait 1
+//
+//****************************************************************************
+int Lcd_queue_free() {
+	return (_lcd->qTail - _lcd->qWrite - 1) & LCD_QUEUE_MASK;
+}
+
+//****************************************************************************
+//
+//! Set the bus speed
+//!
+//! \param ulHz: I2C clock given to I2C_IF_Open, 100000 or 400000
+//!
+//! This function
+//!    1. Sets the clock the scheduler uses to count the time of a transfer
+//!		  against the command waits of the other displays
+//!
+//****************************************************************************
+void Lcd_bus_speed(unsigned long ulHz) {
+	if (ulHz != 0)
+		_busHz = ulHz;
+}
+
+//****************************************************************************
+//
+//! Set the bus budget
+//!
+//! \param ucStates: most expander states sent to a display before the
+//!		   scheduler moves on to the next one, up to LCD_BURST_SIZE
+//!
+//****************************************************************************
+void Lcd_bus_budget(unsigned char ucStates) {
+	if (ucStates == 0 || ucStates > LCD_BURST_SIZE)
+		ucStates = LCD_BURST_SIZE;
+	_qBudget = ucStates;
+}
+
+//****************************************************************************
+//
+//! Entries queued for every display
+//!
+//! \return number of entries, a pending wait counts as one
+//
+//****************************************************************************
+static int Lcd_queue_pending() {
+	unsigned char i;
+	int iPending = 0;
+
+	for (i = 0; i < _deviceCount; i++) {
+		tLcd *pLcd = _devices[i];
+		iPending += (pLcd->qHead - pLcd->qTail) & LCD_QUEUE_MASK;
+		if (pLcd->qWaitUs)
+			iPending++;
+	}
+	return iPending;
+}
+
+//****************************************************************************
+//
+//! Count time against the display waits
+//!
+//! \param us: microseconds since the last call
+//!
+//****************************************************************************
+static void Lcd_queue_elapse(unsigned long us) {
+	unsigned char i;
+
+	for (i = 0; i < _deviceCount; i++) {
+		tLcd *pLcd = _devices[i];
+		pLcd->qWaitUs = (pLcd->qWaitUs > us) ? pLcd->qWaitUs - us : 0;
+	}
+}
+
+//****************************************************************************
+//
+//! Service the transmit queues
+//!
+//! This function
+//!    1. Does nothing while a transfer or a wait is in progress
+//!    2. Turns the waits at the head of each queue into a time left, and
+//!		  counts the last transfer against it, so a display executing a
+//!		  command does not hold the bus
+//!    3. Sends, in a single I2C transaction, the expander states of the next
+//!		  ready display in round robin order, up to its next wait or the bus
+//!		  budget
+//!    4. Waits for the display that gets ready first when every display with
+//!		  something queued is executing a command
+//!    5. Keeps the states queued when the port refuses the write, and
+//!		  tries again after LCD_QUEUE_RETRY_US
+//!
+//! \Note: with an interrupt driven port it runs from the I2C and timer
+//!		   interrupts, and Lcd_trace records the queue when it is published
+//!		   instead. Without a port it sends synchronously and may be polled.
+//!
+//! \return number of entries still queued, a pending wait included
+//
+//****************************************************************************
+int Lcd_queue_service() {
+	tLcd *pLcd = NULL;
+	unsigned long ulWait = 0;
+	unsigned short tail;
+	unsigned char len = 0;
+	unsigned char i;
+	int iPending = 0;
+
+	if (_qBusy)
+		return Lcd_queue_pending();
+	Lcd_queue_elapse(_qInFlightUs);
+	_qInFlightUs = 0;
+
+	for (i = 0; i < _deviceCount; i++) {
+		tLcd *pDev = _devices[i];
+		tail = pDev->qTail;
+		while (tail != pDev->qHead && (pDev->queue[tail] & LCD_QUEUE_WAIT)) {
+			pDev->qWaitUs += pDev->queue[tail] & LCD_QUEUE_MAX_WAIT;
+			tail = (tail + 1) & LCD_QUEUE_MASK;
+		}
+		pDev->qTail = tail;
+		iPending += (pDev->qHead - tail) & LCD_QUEUE_MASK;
+		if (pDev->qWaitUs) {
+			iPending++;
+			if (ulWait == 0 || pDev->qWaitUs < ulWait)
+				ulWait = pDev->qWaitUs;
+		}
+	}
+	for (i = 0; i < _deviceCount && pLcd == NULL; i++) {
+		tLcd *pDev = _devices[(_qNext + i) % _deviceCount];
+		if (pDev->qTail != pDev->qHead && pDev->qWaitUs == 0) {
+			pLcd = pDev;
+			_qNext = (_qNext + i + 1) % _deviceCount;
+		}
+	}
+	if (iPending == 0)
+		return 0;
+
+	_qBusy = 1;
+	if (pLcd == NULL) {
+		_qInFlightUs = ulWait;
+		if (_port != NULL) {
+			_port->pfnWait(ulWait);
+		} else {
+			LCD_TRACE_DELAY(ulWait);
+			if (_clock != NULL) {
+				Lcd_wait_until(Lcd_micros() + ulWait);
+			} else {
+				LCD_STAT_ADD(waitUs, ulWait);
+				US_DELAY(ulWait);
+			}
+			_qBusy = 0;
+		}
+		return iPending;
+	}
+	tail = pLcd->qTail;
+	while (tail != pLcd->qHead && !(pLcd->queue[tail] & LCD_QUEUE_WAIT)
+			&& len < _qBudget) {
+		_qTx[len++] = (unsigned char)pLcd->queue[tail];
+		tail = (tail + 1) & LCD_QUEUE_MASK;
+	}
+	// start, address and stop, then 9 clocks a state
+	_qInFlightUs = ((unsigned long)len * 9 + 11) * 1000000 / _busHz;
+	if (_port != NULL) {
+		LCD_STAT_ADD(transactions, 1);
+		LCD_STAT_ADD(bytes, len);
+		if (_port->pfnWrite(pLcd->addr, _qTx, len) != SUCCESS) {
+			// the states stay queued, the end of the wait tries again
+			LCD_STAT_ADD(failures, 1);
+			_qInFlightUs = LCD_QUEUE_RETRY_US;
+			_port->pfnWait(LCD_QUEUE_RETRY_US);
+			return iPending;
+		}
+		pLcd->qTail = tail;
+		iPending -= len;
+	} else {
+		pLcd->qTail = tail;
+		iPending -= len;
+		if (Lcd_i2c_write(pLcd->addr, _qTx, len) != SUCCESS)
+			DBG_PRINT("I2C queue write failed\n\r");
+		_qBusy = 0;
+	}
+	return iPending;
+}
+
+//****************************************************************************
+//
+//! Transfer or wait finished
+//!
+//! This function
+//!    1. Is called by the transmit port when a write or a wait completes
+//!    2. Starts the next queue entry
+//!
+//****************************************************************************
+void Lcd_queue_done() {
+	_qBusy = 0;
+	Lcd_queue_service();
+}
+
+//****************************************************************************
+//
+//! Put a formatted field into a buffer
+//!
+//! \param pcBuf: output buffer
+//! \param piLen: characters already in the buffer, updated
+//! \param iSize: buffer size, the NULL terminator included
+//! \param pcDigits: field text
+//! \param iDigits: number of characters in pcDigits
+//! \param cSign: sign character or 0
+//! \param iWidth: minimum field width
+//! \param ucFlags: LCD_FMT_LEFT, LCD_FMT_ZERO
+//!
+//****************************************************************************
+static void Lcd_format_field(char *pcBuf, int *piLen, int iSize,
+		const char *pcDigits, int iDigits, char cSign, int iWidth,
+		unsigned char ucFlags) {
+	int iPad = iWidth - iDigits - (cSign ? 1 : 0);
+	int iLen = *piLen;
+
+	if (!(ucFlags & (LCD_FMT_LEFT | LCD_FMT_ZERO))) {
+		for (; iPad > 0 && iLen < iSize - 1; iPad--)
+			pcBuf[iLen++] = ' ';
+	}
+	if (cSign && iLen < iSize - 1)
+		pcBuf[iLen++] = cSign;
+	if (ucFlags & LCD_FMT_ZERO && !(ucFlags & LCD_FMT_LEFT)) {
+		for (; iPad > 0 && iLen < iSize - 1; iPad--)
+			pcBuf[iLen++] = '0';
+	}
+	for (; iDigits > 0 && iLen < iSize - 1; iDigits--)
+		pcBuf[iLen++] = *pcDigits++;
+	for (; iPad > 0 && iLen < iSize - 1; iPad--)
+		pcBuf[iLen++] = ' ';
+	*piLen = iLen;
+}
+
+//****************************************************************************
+//
+//! Write the digits of a number, most significant first
+//!
+//! \param pcOut: at least LCD_FMT_DIGITS characters
+//! \param ulValue: number
+//! \param ucBase: 10 or 16
+//! \param cHexA: 'a' or 'A'
+//! \param iMin: minimum number of digits
+//!
+//! \return number of digits written
+//
+//****************************************************************************
+static int Lcd_format_digits(char *pcOut, unsigned long ulValue,
+		unsigned char ucBase, char cHexA, int iMin) {
+	char acTmp[LCD_FMT_DIGITS];
+	int iLen = 0, i;
+	do {
+		unsigned char ucDigit = ulValue % ucBase;
+		acTmp[iLen++] = (ucDigit < 10) ? '0' + ucDigit : cHexA + ucDigit - 10;
+		ulValue /= ucBase;
+	} while (ulValue != 0);
+	for (; iLen < iMin && iLen < (int)sizeof(acTmp); )
+		acTmp[iLen++] = '0';
+	for (i = 0; i < iLen; i++)
+		pcOut[i] = acTmp[iLen - 1 - i];
+	return iLen;
+}
+
+//****************************************************************************
+//
+//! Format a string without the C library
+//!
+//! \param pcBuf: output buffer
+//! \param iSize: buffer size, the NULL terminator included
+//! \param pcFormat: printf style format
+//! \param list: arguments
+//!
+//! Supported conversions: %d %i %u %x %X %c %s %f %%, with the '-' and '0'
+//! flags, a width, a precision and the 'l' length modifier. %f prints a
+//! double as fixed point with the precision as number of decimals (2 if
+//! omitted), using integer arithmetic only, and LCD_FMT_OVERFLOW for a
+//! value beyond the range of an unsigned long or not a number.
+//!
+//! \return number of characters written, the output is truncated to fit
+//
+//****************************************************************************
+int Lcd_vformat(char *pcBuf, int iSize, const char *pcFormat, va_list list) {
+	// an integer part, the point and up to 9 decimals
+	char acDigits[LCD_FMT_DIGITS * 2 + 1];
+	int iLen = 0;
+
+	if (iSize <= 0)
+		return 0;
+	while (*pcFormat != '\0' && iLen < iSize - 1) {
+		unsigned char ucFlags = 0;
+		int iWidth = 0, iPrec = -1, iDigits = 0;
+		unsigned long ulValue;
+		char cSign = 0;
+		char c = *pcFormat++;
+
+		if (c != '%') {
+			pcBuf[iLen++] = c;
+			continue;
+		}
+		for (;; pcFormat++) {
+			if (*pcFormat == '-')
+				ucFlags |= LCD_FMT_LEFT;
+			else if (*pcFormat == '0')
+				ucFlags |= LCD_FMT_ZERO;
+			else
+				break;
+		}
+		while (*pcFormat >= '0' && *pcFormat <= '9')
+			iWidth = iWidth * 10 + (*pcFormat++ - '0');
+		if (*pcFormat == '.') {
+			iPrec = 0;
+			pcFormat++;
+			while (*pcFormat >= '0' && *pcFormat <= '9')
+				iPrec = iPrec * 10 + (*pcFormat++ - '0');
+		}
+		if (*pcFormat == 'l') {
+			ucFlags |= LCD_FMT_LONG;
+			pcFormat++;
+		}
+		c = *pcFormat;
+		if (c == '\0')
+			break;
+		pcFormat++;
+
+		switch (c) {
+		case 'd':
+		case 'i': {
+			long lValue = (ucFlags & LCD_FMT_LONG) ?
+					va_arg(list, long) : va_arg(list, int);
+			if (lValue < 0) {
+				cSign = '-';
+				ulValue = 0UL - (unsigned long)lValue;
+			} else {
+				ulValue = lValue;
+			}
+			iDigits = Lcd_format_digits(acDigits, ulValue, 10, 'a', iPrec);
+			break;
+		}
+		case 'u':
+			ulValue = (ucFlags & LCD_FMT_LONG) ?
+					va_arg(list, unsigned long) : va_arg(list, unsigned int);
+			iDigits = Lcd_format_digits(acDigits, ulValue, 10, 'a', iPrec);
+			break;
+		case 'x':
+		case 'X':
+			ulValue = (ucFlags & LCD_FMT_LONG) ?
+					va_arg(list, unsigned long) : va_arg(list, unsigned int);
+			iDigits = Lcd_format_digits(acDigits, ulValue, 16,
+					(c == 'x') ? 'a' : 'A', iPrec);
+			break;
+		case 'f': {
+			double dValue = va_arg(list, double);
+			unsigned long ulScale = 1, ulFrac;
+			int i;
+			if (iPrec < 0)
+				iPrec = 2;
+			if (iPrec > 9)
+				iPrec = 9;
+			for (i = 0; i < iPrec; i++)
+				ulScale *= 10;
+			if (dValue < 0) {
+				cSign = '-';
+				dValue = -dValue;
+			}
+			// scale once, then everything is integer arithmetic. The cast is
+			// only defined inside the range, NaN fails the test.
+			ulValue = 0;
+			ulFrac = 0;
+			if (dValue < LCD_FMT_RANGE) {
+				ulValue = (unsigned long)dValue;
+				ulFrac = (unsigned long)((dValue - ulValue) * ulScale + 0.5);
+				if (ulFrac >= ulScale) {
+					ulValue++;
+					ulFrac -= ulScale;
+				}
+			}
+			// out of range, not a number or rounded up past ULONG_MAX
+			if (!(dValue < LCD_FMT_RANGE) || (ulValue == 0 && dValue >= 1.0)) {
+				iDigits = sizeof(LCD_FMT_OVERFLOW) - 1;
+				memcpy(acDigits, LCD_FMT_OVERFLOW, iDigits);
+				ucFlags &= ~LCD_FMT_ZERO;
+				break;
+			}
+			iDigits = Lcd_format_digits(acDigits, ulValue, 10, 'a', 1);
+			if (iPrec > 0) {
+				acDigits[iDigits++] = '.';
+				iDigits += Lcd_format_digits(&acDigits[iDigits], ulFrac, 10,
+						'a', iPrec);
+			}
+			break;
+		}
+		case 'c':
+			acDigits[0] = (char)va_arg(list, int);
+			iDigits = 1;
+			ucFlags &= ~LCD_FMT_ZERO;
+			break;
+		case 's': {
+			const char *pcStr = va_arg(list, const char *);
+			if (pcStr == NULL)
+				pcStr = "(null)";
+			for (iDigits = 0; pcStr[iDigits] != '\0'
+					&& (iPrec < 0 || iDigits < iPrec); iDigits++)
+				;
+			Lcd_format_field(pcBuf, &iLen, iSize, pcStr, iDigits, 0, iWidth,
+					ucFlags & ~LCD_FMT_ZERO);
+			continue;
+		}
+		default:
+			// %% and unknown conversions print the character
+			pcBuf[iLen++] = c;
+			continue;
+		}
+		if (iPrec >= 0 && c != 'f')
+			ucFlags &= ~LCD_FMT_ZERO;
+		Lcd_format_field(pcBuf, &iLen, iSize, acDigits, iDigits, cSign, iWidth,
+				ucFlags);
+	}
+	pcBuf[iLen] = '\0';
+	return iLen;
+}
+
+//****************************************************************************
+//
+//! Print Lcd string
+//!
+//! \param format is a pointer to the character string specifying the format in
+//!           the following arguments need to be interpreted.
+//! \param [variable number of] arguments according to the format in the first
+//!         parameters
+//! This function
+//!    1. Formats a printf style string with Lcd_vformat into a buffer as
+//!		  wide as the display, no heap is used
+//!    2. Prints it into the lcd, truncated at the end of the row, or of the
+//!		  screen with Lcd_wrap enabled
+//!
+//! \return number of characters printed (bytes unless Lcd_rom is set) or
+//!		   LCD_QUEUE_FULL when the asynchronous queue has no room for the string
+//!
+//****************************************************************************
+
+int Lcd_Print(const char *pcFormat, ...)
+{
+	char acBuff[LCD_MAX_COLS * LCD_UTF8_MAX + 1];
+	int iRet = 0;
+	int iSize = 0;
+	int iCells = _lcd->cols - _lcd->curx;
+
+	va_list list;
+	if (_lcd->wrap == ENABLE)
+	{
+		// the rest of the screen, the rows below continue the text
+		iCells = (_lcd->rows - _lcd->cury) * _lcd->cols - _lcd->curx;
+	}
+	if (iCells > 0)
+	{
+		// UTF-8 takes up to LCD_UTF8_MAX bytes a column
+		iSize = iCells * ((_lcd->rom != LCD_ROM_RAW) ? LCD_UTF8_MAX : 1) + 1;
+		if (iSize > (int)sizeof(acBuff))
+		{
+			iSize = sizeof(acBuff);
+		}
+	}
+	va_start(list,pcFormat);
+	iRet = Lcd_vformat(acBuff,iSize,pcFormat,list);
+	va_end(list);
+	if (iRet == 0)
+	{
+		return 0;
+	}
 
-// When the display powers up, it is configured as follows:
+	LCD_STAT_ENTER();
+	Lcd_burst_begin();
+	if (_lcd->rom != LCD_ROM_RAW)
+	{
+		iRet = Lcd_message_rom(acBuff, iCells);
+	}
+	else
+	{
+		Lcd_message(acBuff);
+	}
+	if (Lcd_burst_end() == LCD_QUEUE_FULL)
+	{
+		iRet = LCD_QUEUE_FULL;
+	}
+	LCD_STAT_EXIT(LCD_STAT_PRINT);
+
+	return iRet;
+}
+
+//****************************************************************************
 //
-// 1. Display clear
-// 2. Function set:
-//    DL = 1; 8-bit interface data
-//    N = 0; 1-line display
-//    F = 0; 5x8 dot character font
-// 3. Display on/off control:
-//    D = 0; Display off
-//    C = 0; Cursor off
-//    B = 0; Blinking off
-// 4. Entry mode set:
-//    I/D = 1; Increment by 1
-//    S = 0; No shift
+//! Format a field value
+//!
+//! \param pcBuf: output buffer
+//! \param iSize: buffer size
+//! \param pcFormat: field format
+//! \param [variable number of] the value, a long or a double
+//!
+//! \return number of characters in the buffer
 //
+//****************************************************************************
+static int Lcd_field_format(char *pcBuf, int iSize, const char *pcFormat, ...) {
+	va_list list;
+	int iRet;
+
+	va_start(list, pcFormat);
+	iRet = Lcd_vformat(pcBuf, iSize, pcFormat, list);
+	va_end(list);
+	return iRet;
+}
 
 //****************************************************************************
 //
-//! Initialize the LCD
+//! Add a field
 //!
-//! \param cols is the number of cols of the display
-//! \param rows is the number of cols of the display
+//! \param pField: field, owned by the application
+//! \param x: column
+//! \param y: row
+//! \param width: cells, up to the end of the row
+//! \param pcFormat: Lcd_Print format with a single conversion for the value,
+//!		   "%4ld" or "%lu" for LCD_FIELD_LONG and "%5.1f" for LCD_FIELD_FLOAT
+//! \param ucType: LCD_FIELD_LONG or LCD_FIELD_FLOAT
+//! \param pvValue: variable shown, read by every Lcd_service call
+//! \param ulInterval: least time between two refreshes, in milliseconds with
+//!		   Lcd_field_clock and in Lcd_service calls without it
 //!
 //! This function
-//!    1. Initialize the LCD
+//!    1. Adds the field to the selected display, the next Lcd_service
+//!		  shows it
 //!
+//! Example:
+//!		tLcdField luxField;
+//!		Lcd_field_add(&luxField, 5, 1, 6, "%6lu", LCD_FIELD_LONG, &CurrentLux, 250);
+//!		while (1) { ...; Lcd_service(); }
+//!
+//! \return failure when the field is out of the display, success otherwise
 //
 //****************************************************************************
+int Lcd_field_add(tLcdField *pField, unsigned char x, unsigned char y,
+		unsigned char width, const char *pcFormat, unsigned char ucType,
+		const volatile void *pvValue, unsigned long ulInterval) {
+	tLcdField *pIter;
 
-void Lcd_init(unsigned char cols, unsigned char rows) {
-	_cols = cols;
-	_rows = rows;
-	// SEE PAGE 45/46 FOR INITIALIZATION SPECIFICATION!
-	// according to data sheet, we need at least 40ms after power rises above 2.7V
-	// before sending commands.
-	MS_DELAY(200);
-
-	//first
-	Lcd_send_command(0x03);
-	MS_DELAY(5);
-
-	//second
-	Lcd_send_command(0x03);
-	US_DELAY(100);
-
-	//third
-	Lcd_send_command(0x03);
-
-	//Function set
-	Lcd_send_command(LCD_RETURNHOME);
-	Lcd_send_byte(LCD_FUNCTIONSET | LCD_4BITMODE | LCD_2LINE | LCD_5x8DOTS,COMMAND);
-	Lcd_send_byte(LCD_DISPLAYCONTROL | LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF,COMMAND);
-	Lcd_send_byte(LCD_CLEARDISPLAY,COMMAND);
-	//Entry mode set
-	Lcd_send_byte(LCD_ENTRYMODESET|LCD_ENTRYLEFT|LCD_ENTRYSHIFTDECREMENT, COMMAND);
+	if (y >= _lcd->rows || x >= _lcd->cols || width == 0)
+		return FAILURE;
+	if (width > _lcd->cols - x)
+		width = _lcd->cols - x;
+	pField->x = x;
+	pField->y = y;
+	pField->width = width;
+	pField->type = ucType;
+	pField->format = pcFormat;
+	pField->value = pvValue;
+	pField->fnValue = NULL;
+	pField->interval = ulInterval;
+	pField->valid = 0;
+	for (pIter = _lcd->fields; pIter != NULL; pIter = pIter->next) {
+		if (pIter == pField)
+			return SUCCESS;
+	}
+	pField->next = _lcd->fields;
+	_lcd->fields = pField;
+	return SUCCESS;
 }
 
 //****************************************************************************
 //
-//! Clear the lcd
+//! Read a field from a function
 //!
-//! \param None
+//! \param pField: field added with Lcd_field_add
+//! \param pfnValue: returns the value, called by every Lcd_service call
 //!
-//! This function
-//!    1. Clears the lcd screen
+//! \return failure for a LCD_FIELD_FLOAT field, which only reads its
+//!		   variable, success otherwise
 //!
 //****************************************************************************
+int Lcd_field_callback(tLcdField *pField, long (*pfnValue)(void)) {
+	if (pField->type == LCD_FIELD_FLOAT)
+		return FAILURE;
+	pField->fnValue = pfnValue;
+	pField->valid = 0;
+	return SUCCESS;
+}
 
-void Lcd_clear() {
-	Lcd_send_byte(LCD_CLEARDISPLAY,COMMAND); // clear display, set cursor position to zero
-	US_DELAY(2000);  // this command takes a long time!
+//****************************************************************************
+//
+//! Remove a field
+//!
+//! \param pField: field added with Lcd_field_add to the selected display,
+//!		   its text stays on screen
+//!
+//****************************************************************************
+void Lcd_field_remove(tLcdField *pField) {
+	tLcdField **ppIter;
+
+	for (ppIter = &_lcd->fields; *ppIter != NULL; ppIter = &(*ppIter)->next) {
+		if (*ppIter == pField) {
+			*ppIter = pField->next;
+			return;
+		}
+	}
 }
 
 //****************************************************************************
 //
-//! Lcd home
+//! Set the field clock
 //!
-//! \param None
+//! \param pfnMillis: returns a free running millisecond count, NULL counts
+//!		   the refresh intervals in Lcd_service calls
+//!
+//****************************************************************************
+void Lcd_field_clock(unsigned long (*pfnMillis)(void)) {
+	_fieldClock = pfnMillis;
+}
+
+//****************************************************************************
+//
+//! Check the frame of the selected display
 //!
 //! This function
-//!    1. Sets the lcd into the (0,0) position
+//!    1. Times the frames with the driver clock, or the field clock in
+//!		  milliseconds, and starts a new frame once the period has passed
+//!    2. Without a frame rate or any clock every call is a new frame
 //!
+//! \return 1 when a new frame started, 0 otherwise
+//
 //****************************************************************************
-
-void Lcd_home() {
-	Lcd_send_byte(LCD_RETURNHOME,COMMAND);  // set cursor position to zero
-	US_DELAY(2000);  // this command takes a long time!
+static int Lcd_frame_due() {
+	unsigned long ulNow, ulPeriod;
+	if (_lcd->framePeriod == 0)
+		return 1;
+	if (_clock != NULL) {
+		ulNow = Lcd_micros();
+		ulPeriod = _lcd->framePeriod;
+	} else if (_fieldClock != NULL) {
+		ulNow = _fieldClock();
+		ulPeriod = _lcd->framePeriod / 1000;
+	} else {
+		return 1;
+	}
+	if (ulNow - _lcd->frameLast < ulPeriod)
+		return 0;
+	_lcd->frameLast = ulNow;
+	return 1;
 }
 
 //****************************************************************************
 //
-//! Lcd entymode
+//! Set the refresh rate
 //!
-//! \param direction Select the direction of the lcd writing
-//! 		Flags: LCD_ENTRYRIGHT, LCD_ENTRYLEFT
-//! \param shiftdirection Select the shifting direction of the lcd
-//! 		Flags: LCD_ENTRYSHIFTINCREMENT, LCD_ENTRYSHIFTDECREMENT
+//! \param ucHz: frames a second, 0 flushes on every Lcd_service call
 //!
 //! This function
-//!    1. Sets the lcd Entry mode
+//!    1. Turns on framebuffer mode, so the text functions only write into
+//!		  the RAM mirror and several writes to a cell inside one frame
+//!		  collapse into one
+//!    2. Makes Lcd_service flush the selected display at most ucHz times
+//!		  a second, capping its share of the bus however often the
+//!		  application writes
+//!
+//! Example, 20 frames a second:
+//!		Lcd_clock(&clock);
+//!		Lcd_refresh_rate(20);
+//!		while(1) { ...; Lcd_Print(...); ...; Lcd_service(); }
+//!
+//! \Note: the frames need Lcd_clock or Lcd_field_clock, without either one
+//!		   every Lcd_service call flushes.
 //!
 //****************************************************************************
-void Lcd_entymode(unsigned char direction, unsigned char shiftdirection) {
-	Lcd_send_byte(LCD_ENTRYMODESET|direction|shiftdirection,COMMAND);
-	US_DELAY(2000);  // this command takes a long time!
+void Lcd_refresh_rate(unsigned char ucHz) {
+	_lcd->framePeriod = (ucHz != 0) ? 1000000UL / ucHz : 0;
+	if (ucHz != 0)
+		Lcd_framebuffer(ENABLE);
 }
 
+//****************************************************************************
+//
+//! Read the time base of the backlight timeout
+//!
+//! \param pulScale: returns the clock units in a millisecond
+//!
+//! \return driver clock in microseconds, or the field clock in milliseconds,
+//!		   0 with neither one
+//
+//****************************************************************************
+static unsigned long Lcd_idle_now(unsigned long *pulScale) {
+	if (_clock != NULL) {
+		*pulScale = 1000;
+		return Lcd_micros();
+	}
+	*pulScale = 1;
+	return (_fieldClock != NULL) ? _fieldClock() : 0;
+}
 
 //****************************************************************************
 //
-//! Lcd Display Control
+//! Apply the backlight timeout
 //!
-//! \param display Turns the display on or off
-//! 		Flags: LCD_DISPLAYON, LCD_DISPLAYOFF
-//! \param cursor Turns the cursor on or off
-//! 		Flags: LCD_CURSORON, LCD_CURSOROFF
-//! \param blink Turns the blink on or off
-//! 		Flags: LCD_BLINKON, LCD_BLINKOFF
 //! This function
-//!    1. Controls the lcd display
-//!
+//!    1. Restarts the timeout when cells were written into DDRAM since the
+//!		  last call, switching the backlight back on if the timeout had
+//!		  switched it off
+//!    2. Switches the backlight off once the timeout passed
+//
 //****************************************************************************
-void Lcd_displaycontrol(unsigned char display, unsigned char cursor, unsigned char blink) {
-	Lcd_send_byte(LCD_DISPLAYCONTROL|display|cursor|blink,COMMAND);
-	US_DELAY(2000);  // this command takes a long time!
+static void Lcd_backlight_idle() {
+	unsigned long ulScale;
+	unsigned long ulNow = Lcd_idle_now(&ulScale);
+
+	if (_lcd->idleActive) {
+		_lcd->idleActive = 0;
+		_lcd->activeAt = ulNow;
+		if (_lcd->idleDark)
+			Lcd_backlight(ENABLE);
+	} else if (!_lcd->idleDark && _lcd->backlightval != 0
+			&& ulNow - _lcd->activeAt >= _lcd->idleTimeout * ulScale) {
+		Lcd_backlight(DISABLE);
+		_lcd->idleDark = 1;
+	}
 }
 
 //****************************************************************************
 //
-//! Lcd cursor shift
+//! Refresh the fields
 //!
-//! \param move Move the display or the cursor
-//! 		Flags: LCD_DISPLAYMOVE, LCD_CURSORMOVE
-//! \param direction the direction of the shift
-//! 		Flags: LCD_MOVERIGHT, LCD_MOVELEFT
 //! This function
-//!    1. Shifts the cursor or the display
+//!    1. Reads the value of every field of every display
+//!    2. Formats only the fields whose value changed and whose refresh
+//!		  interval has passed, into the RAM mirror
+//!    3. Flushes the displays, which sends only the characters that
+//!		  changed. The displays in framebuffer mode are always flushed, so
+//!		  it also replaces Lcd_flush in the main loop. A display with a
+//!		  refresh rate is flushed only once its frame is due.
+//!    4. Switches the backlight off after the Lcd_backlight_timeout
+//!		  without new cells, and back on with the next one
+//!    5. Reads back the next Lcd_verify cells of the displays that have it
+//!		  set, with Lcd_verify_step
 //!
+//! \return number of fields refreshed, LCD_QUEUE_FULL when a flush did not
+//!		   fit in the asynchronous queue, the next call carries on, or failure
+//!		   inside a burst or when a read back failed
+//
 //****************************************************************************
-void Lcd_cursorshift(unsigned char move, unsigned char direction) {
-	Lcd_send_byte(LCD_CURSORSHIFT|move|direction,COMMAND);
-	US_DELAY(2000);  // this command takes a long time!
+int Lcd_service() {
+	char acBuff[LCD_MAX_COLS + 1];
+	tLcd *pSelected = _lcd;
+	unsigned long ulNow;
+	unsigned long ulValue;
+	unsigned char i, ucChanged, ucActive;
+	int iCount = 0;
+	int iRet = SUCCESS;
+	int iLen;
+	tLcdField *pField;
+	float fValue = 0.0f;
+	long lValue;
+
+	if (_burstDepth)
+		return FAILURE;
+	LCD_STAT_ENTER();
+	ulNow = (_fieldClock != NULL) ? _fieldClock() : ++_serviceCount;
+	for (i = 0; i < _deviceCount; i++) {
+		_lcd = _devices[i];
+		ucChanged = 0;
+		for (pField = _lcd->fields; pField != NULL; pField = pField->next) {
+			if (pField->valid && ulNow - pField->last < pField->interval)
+				continue;
+			if (pField->type == LCD_FIELD_FLOAT) {
+				fValue = *(const volatile float *)pField->value;
+				ulValue = 0;
+				memcpy(&ulValue, &fValue, sizeof(fValue));
+			} else {
+				lValue = (pField->fnValue != NULL) ? pField->fnValue()
+						: *(const volatile long *)pField->value;
+				ulValue = (unsigned long)lValue;
+			}
+			if (pField->valid && ulValue == pField->shown)
+				continue;
+			if (pField->type == LCD_FIELD_FLOAT)
+				iLen = Lcd_field_format(acBuff, pField->width + 1,
+						pField->format, (double)fValue);
+			else
+				iLen = Lcd_field_format(acBuff, pField->width + 1,
+						pField->format, lValue);
+			memset(acBuff + iLen, ' ', pField->width - iLen);
+			memcpy(&_lcd->fb[pField->y][pField->x], acBuff, pField->width);
+			pField->shown = ulValue;
+			pField->last = ulNow;
+			pField->valid = 1;
+			ucChanged = 1;
+			iCount++;
+		}
+		if (ucChanged)
+			_lcd->frameDirty = 1;
+		if ((_lcd->frameDirty || _lcd->fbMode == ENABLE) && Lcd_frame_due()) {
+			_lcd->frameDirty = 0;
+			if (Lcd_flush() == LCD_QUEUE_FULL) {
+				_lcd->frameDirty = 1;
+				iRet = LCD_QUEUE_FULL;
+			}
+		}
+		if (_lcd->idleTimeout != 0)
+			Lcd_backlight_idle();
+		// a repair is not activity for the backlight timeout
+		ucActive = _lcd->idleActive;
+		if (_lcd->verifyCells != 0 && _asyncMode != ENABLE
+				&& Lcd_verify_step() == FAILURE)
+			iRet = FAILURE;
+		_lcd->idleActive = ucActive;
+	}
+	_lcd = pSelected;
+	LCD_STAT_EXIT(LCD_STAT_SERVICE);
+	return (iRet != SUCCESS) ? iRet : iCount;
 }
 
 //****************************************************************************
 //
-//! Lcd (x,y) position
+//! Lcd backlight
 //!
-//!			**************************
-//!			**(0,0)			  (15,0)**
-//!			**(0,1)			  (15,1)**
-//!			**************************
+//! \param value: blacklight flag status
+//! 		Flags: ENABLE, DISABLE
 //!
-//! \param xCoor: Horizontal coordinate, starts in 0
-//! \param yCoor: Vertical coordinate, starts in 0
 //! This function
-//!    1. Sets the cursor in the desired coordinate
+//!    1. Turns the lcd backlight on or off
+//!    2. Restarts the Lcd_backlight_timeout when turned on
 //!
 //****************************************************************************
-void Lcd_gotoxy(unsigned char xCoor, unsigned char yCoor) {
-	int row_offsets[] = { 0x00, 0x40, 0x14, 0x54 };
-	if (yCoor > _rows) {
-		yCoor = _rows - 1;    // we count rows starting w/0
+void Lcd_backlight(unsigned char value) {
+	unsigned long ulScale;
+	if (value == ENABLE) {
+		_lcd->backlightval = LCD_BACKLIGHT;
+		_lcd->activeAt = Lcd_idle_now(&ulScale);
+	} else {
+		_lcd->backlightval = 0;
 	}
-	Lcd_send_byte(LCD_SETDDRAMADDR | (xCoor + row_offsets[yCoor]),COMMAND);
+	_lcd->idleDark = 0;
+	Lcd_WriteI2C(0);
 }
 
 //****************************************************************************
 //
-//! Fill the first 8 CGRAM locations with custom characters
+//! Lcd backlight timeout
 //!
-//! Examples;
-//!		unsigned char bell[8]	 = 	{0x0, 0xa, 0x1f, 0x1f, 0xe, 0x4, 0x0};
-//!		unsigned char note[8]  	= 	{0x2, 0x3, 0x2, 0xe, 0x1e, 0xc, 0x0};
-//!		unsigned char clock[8] 	= 	{0x0, 0xe, 0x15, 0x17, 0x11, 0xe, 0x0};
-//!		unsigned char heart[8] 	= 	{0x0, 0xa, 0x1f, 0x1f, 0xe, 0x4, 0x0};
-//!		unsigned char duck[8]  	= 	{0x0, 0xc, 0x1d, 0xf, 0xf, 0x6, 0x0};
-//!		unsigned char check[8] 	= 	{0x0, 0x1, 0x3, 0x16, 0x1c, 0x8, 0x0};
-//!		unsigned char cross[8] 	= 	{0x0, 0x1b, 0xe, 0x4, 0xe, 0x1b, 0x0};
-//!		unsigned char retarrow[8] = {0x1, 0x1, 0x5, 0x9, 0x1f, 0x8, 0x4};
+//! \param ulMs: milliseconds without new cells before Lcd_service switches
+//!		   the backlight off, 0 keeps it on
 //!
-//!		Lcd_createChar(0, bell);
-//!		Lcd_createChar(1, note); so on...
+//! This function
+//!    1. Lets Lcd_service switch the backlight of the selected display off
+//!		  once no cell was written for ulMs, and back on at the first call
+//!		  after the next one. Direct writes such as Lcd_Print count as much
+//!		  as flushes. The LED is the largest load of the module.
 //!
-//!		To print the character:
-//!		Lcd_send_byte(0,DATA);	//Prints bell character
-//!		Lcd_send_byte(1,DATA); 	//Prints note character and so on...
+//! \Note: the timeout needs Lcd_clock or Lcd_field_clock, with the driver
+//!		   clock it must be shorter than 71 minutes. The PCF8574 pin only
+//!		   switches the LED, it cannot dim it.
+//!
+//****************************************************************************
+void Lcd_backlight_timeout(unsigned long ulMs) {
+	unsigned long ulScale;
+	_lcd->idleTimeout = ulMs;
+	_lcd->activeAt = Lcd_idle_now(&ulScale);
+	if (ulMs == 0 && _lcd->idleDark)
+		Lcd_backlight(ENABLE);
+}
+
+//****************************************************************************
+//
+//! Restore the 4-bit sync
 //!
-//! \param location: Location of the character (0-7)
-//! \param charmap[]: Map of the custom character
 //! This function
-//!    1. Sends the custom character to the lcd CGRAM
+//!    1. Sends 0x3 three times and 0x2, which puts the lcd back into 4-bit
+//!		  mode from either nibble phase, or from 8-bit mode after a reset.
+//!		  Out of phase, the first nibble completes an unknown instruction,
+//!		  so it waits as long as the slowest one.
+//!    2. Sends the function set, display control and entry mode again, and
+//!		  a return home that brings the display shift back to 0
+//!    3. Uploads the glyphs of the glyph table again and rewrites every
+//!		  cell of the screen, whatever the lcd held before is unknown
 //!
+//! \return number of cells rewritten, or i2c failure
+//!
+//! \Note: the characters made with Lcd_createChar are not kept by the
+//!		   driver and cannot be uploaded again.
+//
 //****************************************************************************
-void Lcd_createChar(unsigned char location, unsigned char charmap[]) {
-	location &= 0x7; // we only have 8 locations 0-7
-	Lcd_send_byte(LCD_SETCGRAMADDR | (location << 3),COMMAND);
-	int i;
-	for (i = 0; i < 8; i++) {
-		Lcd_send_byte(charmap[i],DATA);
+static int Lcd_resync() {
+	unsigned char slot;
+	unsigned char ucNext = LCD_GLYPH_SLOTS;
+	int iRet;
+
+	LCD_STAT_ADD(resyncs, 1);
+	Lcd_burst_begin();
+	Lcd_send_command(0x03);
+	Lcd_delay_us(LCD_CLEAR_US);
+	Lcd_send_command(0x03);
+	Lcd_delay_us(100);
+	Lcd_send_command(0x03);
+	Lcd_send_command(0x02);	// 4-bit mode
+	Lcd_send_byte(LCD_FUNCTIONSET | LCD_4BITMODE | LCD_2LINE | LCD_5x8DOTS,COMMAND);
+	Lcd_send_byte(_lcd->displayCtl, COMMAND);
+	Lcd_send_byte(LCD_ENTRYMODESET | (_lcd->entryLeft ? LCD_ENTRYLEFT : 0)
+			| (_lcd->entryShift ? LCD_ENTRYSHIFTINCREMENT : 0), COMMAND);
+	Lcd_command(LCD_RETURNHOME);
+	Lcd_mirror_invalidate();
+	for (slot = 0; slot < LCD_GLYPH_SLOTS; slot++) {
+		if (_glyphTable == NULL || _lcd->glyphId[slot] >= _glyphCount)
+			continue;
+		if (slot != ucNext)
+			Lcd_send_byte(LCD_SETCGRAMADDR | (slot << 3), COMMAND);
+		Lcd_send_data(_glyphTable[_lcd->glyphId[slot]], 8);
+		ucNext = slot + 1;
 	}
+	iRet = Lcd_flush();
+	if (Lcd_burst_end() != SUCCESS || iRet != SUCCESS)
+		return FAILURE;
+	return _flushSent;
 }
 
-
 //****************************************************************************
 //
-//! Sends char by char the data string
+//! Lcd read back
+//!
+//! \param ucCells: cells read back by each Lcd_service call, up to 80, 0
+//!		   turns the read back off (the default)
 //!
-//! \param str: string pointer
 //! This function
-//!    1. Sends char by char the data string,
-//!		  stops until it finds the NULL character
+//!    1. Sets the bus budget of Lcd_verify_step. Each cell costs two I2C
+//!		  writes and two reads, about 1ms at 100kHz, plus the DDRAM
+//!		  address and a status read per call.
+//!
+//! Example, a 16x2 checked in 4 calls:
+//!		Lcd_verify(8);
+//!		while(1) { ...; Lcd_service(); }
+//!
+//! \Note: the module RW line (P1) must be wired to the lcd, as for
+//!		   Lcd_busyflag. A 40x4 cannot be read and keeps it off.
 //!
 //****************************************************************************
-
-void Lcd_message(const char *str)
-{
-    if(str != NULL)
-    {
-        while(*str!='\0')
-        {
-        	Lcd_send_byte(*str++,DATA);
-        }
-    }
+void Lcd_verify(unsigned char ucCells) {
+	if (ucCells > LCD_DDRAM_CHARS)
+		ucCells = LCD_DDRAM_CHARS;
+	_lcd->verifyCells = _lcd->dual ? 0 : ucCells;
 }
 
-
 //****************************************************************************
 //
-//! Print Lcd string
+//! Check the next cells of the screen
 //!
-//! \param format is a pointer to the character string specifying the format in
-//!           the following arguments need to be interpreted.
-//! \param [variable number of] arguments according to the format in the first
-//!         parameters
 //! This function
-//!    1. Prints a printf style string into the lcd
+//!    1. Takes the next run of visible cells that follow each other in
+//!		  DDRAM, up to the Lcd_verify budget, going round the screen over
+//!		  the calls
+//!    2. Sets the DDRAM address of the run and reads the address counter
+//!		  back. A wrong address means the lcd lost the 4-bit sync, e.g.
+//!		  after an ESD hit or a brown-out, and Lcd_resync restores it
+//!		  without the 40ms and 4.1ms waits of Lcd_init.
+//!    3. Otherwise reads the run and rewrites only the cells that differ
+//!		  from the DDRAM mirror
+//!
+//! \return number of cells rewritten, or i2c failure
+//!
+//! \Note: does nothing in asynchronous mode, which cannot read, or while
+//!		   the entry mode shifts the display.
 //!
 //****************************************************************************
+int Lcd_verify_step() {
+	unsigned char aucRead[LCD_DDRAM_CHARS];
+	unsigned char addr, start, x, y, i;
+	unsigned char ucStatus = 0;
+	unsigned char n = 0;
+	unsigned short cell;
+	int iCount = 0;
 
-int Lcd_Print(const char *pcFormat, ...)
-{
-	int iRet = 0;
-
-	char *pcBuff, *pcTemp;
-	int iSize = 256;
-
-	va_list list;
-	pcBuff = (char*)malloc(iSize);
-	if(pcBuff == NULL)
-	{
-		return -1;
-	}
-	while(1)
-	{
-		va_start(list,pcFormat);
-		iRet = vsnprintf(pcBuff,iSize,pcFormat,list);
-		va_end(list);
-		if(iRet > -1 && iRet < iSize)
-		{
+	if (_lcd->verifyCells == 0 || _asyncMode == ENABLE || _lcd->entryShift
+			|| _lcd->initStep != LCD_INIT_DONE)
+		return 0;
+	addr = _lcd->verifyAddr;
+	start = addr;
+	for (i = 0; i < LCD_DDRAM_CHARS && n < _lcd->verifyCells; i++) {
+		if (Lcd_cell_of(addr, &x, &y)) {
+			if (n++ == 0)
+				start = addr;
+		} else if (n) {
 			break;
 		}
-		else
-		{
-			iSize*=2;
-			if((pcTemp=realloc(pcBuff,iSize))==NULL)
-			{
-				Message("Could not reallocate memory\n\r");
-				iRet = -1;
-				break;
-			}
-			else
-			{
-				pcBuff=pcTemp;
-			}
+		addr = Lcd_ddram_next(addr);
+	}
+	_lcd->verifyAddr = addr;
+	if (n == 0)
+		return 0;
 
-		}
+	Lcd_set_ddram(start);
+	for (i = 0; i < LCD_BUSY_POLLS; i++) {
+		RET_IF_ERR(Lcd_read_bytes(COMMAND, &ucStatus, 1));
+		if (!(ucStatus & LCD_BUSY_FLAG))
+			break;
 	}
+	// busy flag low and the address counter where it was just set
+	if (ucStatus != start)
+		return Lcd_resync();
+	RET_IF_ERR(Lcd_read_bytes(DATA, aucRead, n));
+	// the reads moved the address counter over the run
+	_lcd->hwAddr = addr;
 
-	Lcd_message(pcBuff);
-	free(pcBuff);
+	Lcd_burst_begin();
+	addr = start;
+	for (i = 0; i < n; i++, addr = Lcd_ddram_next(addr)) {
+		cell = *Lcd_ddram_cell(addr);
+		if (cell == LCD_CELL_UNKNOWN || cell == aucRead[i])
+			continue;
+		// the framebuffer holds what the cell has to show
+		Lcd_cell_of(addr, &x, &y);
+		if (_lcd->hwAddr != addr)
+			Lcd_set_ddram(addr);
+		Lcd_send_byte(_lcd->fb[y][x], DATA);
+		iCount++;
+	}
+	LCD_STAT_ADD(repairs, iCount);
+	RET_IF_ERR(Lcd_burst_end());
+	return iCount;
+}
 
-	return iRet;
+//****************************************************************************
+//
+//! Enable pins of a byte
+//!
+//! \param value: Command or data to be sent
+//! \param mode: COMMAND or DATA
+//!
+//! This function
+//!    1. Gives E on a module with one controller
+//!    2. On a module with two controllers, sends the DDRAM data and address
+//!		  to the controller of the current rows, and the other commands and
+//!		  the CGRAM data to both, so they keep the same configuration and
+//!		  glyphs
+//!
+//! \return En, E2 or both
+//
+//****************************************************************************
+static unsigned char Lcd_enable_of(unsigned char value, unsigned char mode) {
+	if (!_lcd->dual)
+		return En;
+	if ((mode == DATA && !_lcd->cgram)
+			|| (mode == COMMAND && (value & LCD_SETDDRAMADDR)))
+		return _lcd->ctrl ? E2 : En;
+	return En | E2;
 }
 
 //****************************************************************************
 //
-//! Lcd backlight
+//! Write expander states
 //!
-//! \param value: blacklight flag status
-//! 		Flags: ENABLE, DISABLE
+//! \param pucStates: states from the _encode table
+//! \param ucLen: number of states, up to 4
+//! \param mode: COMMAND or DATA, added to every state
+//! \param ucEn: enable pins pulsed instead of En, from Lcd_enable_of
 //!
 //! This function
-//!    1. Turns the lcd backlight on or off
+//!    1. Moves the E pulses to the enable pins of the controllers the byte
+//!		  is for, on a module with two controllers
+//!    2. Raises or lowers RS with E low first, only when it differs from the
+//!		  last state on the expander, the lcd needs RS settled before E rises
+//!    3. Copies the states straight into the burst buffer when they fit
+//!
+//! \Note: must be called inside Lcd_burst_begin/Lcd_burst_end
 //!
 //****************************************************************************
-void Lcd_backlight(unsigned char value) {
-	if (value == ENABLE)
-		_backlightval = LCD_BACKLIGHT;
-	else
-		_backlightval = 0;
-	Lcd_WriteI2C(0);
+static void Lcd_write_states(const unsigned char *pucStates,
+		unsigned char ucLen, unsigned char mode, unsigned char ucEn) {
+	unsigned char ucCtl = mode | _lcd->backlightval;
+	unsigned char aucStates[4];
+	unsigned char i;
+
+	if (ucEn != En) {
+		for (i = 0; i < ucLen; i++)
+			aucStates[i] = (pucStates[i] & En) ?
+					(pucStates[i] & ~En) | ucEn : pucStates[i];
+		pucStates = aucStates;
+	}
+	if ((_lcd->expState & (Rs | Rw | En | LCD_BACKLIGHT)) != ucCtl)
+		Lcd_WriteI2C(pucStates[1] | mode);
+	if (_asyncMode == ENABLE || LCD_BURST_SIZE - _burstLen < ucLen) {
+		for (i = 0; i < ucLen; i++)
+			Lcd_WriteI2C(pucStates[i] | mode);
+		return;
+	}
+	for (i = 0; i < ucLen; i++)
+		_burstBuf[_burstLen++] = pucStates[i] | ucCtl;
+	_lcd->expState = pucStates[ucLen - 1] | ucCtl;
+}
+
+//****************************************************************************
+//
+//! Send data bytes
+//!
+//! \param pucData: bytes to write into DDRAM or CGRAM
+//! \param uiLen: number of bytes
+//!
+//! This function
+//!    1. Encodes several characters per step with the _encode table, in a
+//!		  single burst
+//!
+//****************************************************************************
+static void Lcd_send_data(const unsigned char *pucData, unsigned int uiLen) {
+	unsigned char ucEn = Lcd_enable_of(0, DATA);
+	Lcd_burst_begin();
+	while (uiLen-- > 0) {
+		Lcd_track(*pucData, DATA);
+		Lcd_write_states(_encode[*pucData++], 4, DATA, ucEn);
+	}
+	Lcd_burst_end();
 }
 
 //****************************************************************************
@@ -364,20 +3735,11 @@ void Lcd_backlight(unsigned char value) {
 //!
 //****************************************************************************
 void Lcd_send_command(unsigned char value) {
-	unsigned char expand;
-	expand = (value & 0x0F) <<4;
-	// RW is set low, send value to D[7:4] and send RS value
-	Lcd_WriteI2C(expand & ~Rw);
-	//Set E to high
-	Lcd_WriteI2C(expand & ~Rw | En);
-	// enable pulse must be >230ns
-	//US_DELAY(1);
-	//Set E to low
-	Lcd_WriteI2C(expand & ~Rw & ~En);
-	// commands need > 1us to settle
-	//set high RW
-	Lcd_WriteI2C(expand & Rw & ~En);
-	//US_DELAY(40);
+	Lcd_burst_begin();
+	// E high then E low with the low nibble on D[7:4], RS and RW low
+	Lcd_write_states(&_encode[value & 0x0F][2], 2, COMMAND,
+			_lcd->dual ? (En | E2) : En);
+	Lcd_burst_end();
 }
 
 //****************************************************************************
@@ -388,35 +3750,17 @@ void Lcd_send_command(unsigned char value) {
 //! \param mode: Select mode: COMMAND or DATA
 //!
 //! This function
-//!    1. Separates value into high and low nibbles
-//!    2. Expands the low nibble into FC-113 pinout format
-//!    3. Sends expanded low nibble to the PCF8574T
-//!    4. Expands the high nibble into FC-113 pinout format
-//!    5. Sends expanded low nibble to the PCF8574T
+//!    1. Looks up the expander states of value in the _encode table
+//!    2. Sends the high nibble and then the low nibble to the PCF8574T,
+//!		  each as E high followed by E low
 //!
 //****************************************************************************
 void Lcd_send_byte(unsigned char value,unsigned char mode) {
-	unsigned char expand[2];
-	expand[1] = value & 0xF0; //high nibble
-	expand[0] = (value & 0x0F) <<4; //low nibble
-
-	int i = 2;
-	do {
-		// RW is set low, send value to D[7:4] and send RS value
-		Lcd_WriteI2C(expand[i-1] & ~Rw | mode);
-		//Set E to high
-		Lcd_WriteI2C(expand[i-1] & ~Rw | En | mode);
-		// enable pulse must be >230ns
-		//US_DELAY(1);
-		//Set E to low
-		Lcd_WriteI2C(expand[i-1] & ~Rw & ~En | mode);
-		// commands need > 1us to settle
-		//set high RW
-		Lcd_WriteI2C(expand[i-1] & Rw & ~En | mode);
-		//US_DELAY(1);
-		i--;
-	}while(i > 0);
-	//US_DELAY(40);
+	unsigned char ucEn = Lcd_enable_of(value, mode);
+	Lcd_track(value, mode);
+	Lcd_burst_begin();
+	Lcd_write_states(_encode[value], 4, mode, ucEn);
+	Lcd_burst_end();
 }
 
 //****************************************************************************
@@ -432,15 +3776,35 @@ void Lcd_send_byte(unsigned char value,unsigned char mode) {
 //!
 //! \Note: the PCF8574T only needs the Address register, if acknowledged,
 //!		   the Microcontrolled sends directly the data, no registers involved.
+//!		   Inside Lcd_burst_begin/Lcd_burst_end the value is only queued.
 //!
 //! \return i2c writing failure or success
 //
 //****************************************************************************
 int Lcd_WriteI2C(unsigned char value) {
-	unsigned char temp = (value | _backlightval);
-	US_DELAY(120);
-	if(I2C_IF_Write(LCDI2C_ADDRESS, &temp, 1, 1) == 0)
+	unsigned char temp = (value | _lcd->backlightval);
+	_lcd->expState = temp;
+	if (_asyncMode == ENABLE)
+	{
+		int iRet;
+		Lcd_burst_begin();
+		iRet = Lcd_queue_push(temp);
+		Lcd_burst_end();
+		return iRet;
+	}
+	if (_burstDepth > 0)
+	{
+		if (_burstLen == LCD_BURST_SIZE)
+		{
+			RET_IF_ERR(Lcd_burst_flush());
+		}
+		_burstBuf[_burstLen++] = temp;
+		return SUCCESS;
+	}
+	Lcd_gap_wait();
+	if(Lcd_i2c_write(_lcd->addr, &temp, 1) == SUCCESS)
 	{
+		Lcd_gap_set(LCD_EXEC_US);
 		return SUCCESS;
 	}
 	else
@@ -23,6 +23,9 @@
 
 #ifndef I2C_LCD_H_
 #define I2C_LCD_H_
+
+#include <stdarg.h>
+
 //*****************************************************************************
 //
 // If building with a C++ compiler, make all of the definitions in this header
@@ -93,6 +96,7 @@ extern "C"
 #define En 0x04  // Enable bit b00000100
 #define Rw 0x02  // Read/Write bit b00000010
 #define Rs 0x01  // Register select bit b00000001
+#define E2 Rw	 // Enable of the rows 2-3 controller of a 40x4, RW tied low
 
 //*****************************************************************************
 // Send byte mode
@@ -104,11 +108,293 @@ extern "C"
 #define DISABLE 0x00
 
 //*****************************************************************************
-// API Variables
+// Burst transfer buffer size, expander states sent in one I2C transaction
+// (I2C_IF_Write takes an unsigned char length, so it must be < 256)
+//*****************************************************************************
+#ifndef LCD_BURST_SIZE
+#define LCD_BURST_SIZE	128
+#endif
+
+//*****************************************************************************
+// Asynchronous transmit queue, each entry is an expander state or a wait
+// (LCD_QUEUE_SIZE must be a power of 2)
+//*****************************************************************************
+#ifndef LCD_QUEUE_SIZE
+#define LCD_QUEUE_SIZE	512
+#endif
+#define LCD_QUEUE_FULL	-2	// the call did not fit and nothing was queued
+
+//*****************************************************************************
+// Transmit port used to drain the queue. pfnWrite starts an I2C write and
+// pfnWait a timer, both call Lcd_queue_done when finished. A pfnWrite that
+// returns failure started nothing, its states are sent again after a wait.
+// pfnKick starts draining from thread context with the port interrupts
+// masked.
+//*****************************************************************************
+typedef struct
+{
+	int  (*pfnWrite)(unsigned char ucAddr, unsigned char *pucData, unsigned char ucLen);
+	void (*pfnWait)(unsigned long ulMicros);
+	void (*pfnKick)(void);
+} tLcdPort;
+
+//*****************************************************************************
+// Microsecond clock used to time the lcd command gaps. pfnMicros returns a
+// free running count that wraps around, pfnSleep blocks for about ulMicros
+// (NULL spins on pfnMicros). Without a clock the driver uses UtilsDelay.
 //*****************************************************************************
-unsigned char _backlightval;
-unsigned char _cols;
-unsigned char _rows;
+typedef struct
+{
+	unsigned long (*pfnMicros)(void);
+	void (*pfnSleep)(unsigned long ulMicros);
+} tLcdClock;
+#ifndef LCD_EXEC_US
+#define LCD_EXEC_US		41		// execution time of a command or data write
+#endif
+#ifndef LCD_CLEAR_US
+#define LCD_CLEAR_US	1520	// execution time of clear display and return home
+#endif
+
+//*****************************************************************************
+// Largest geometry kept in the RAM mirror of the display
+//*****************************************************************************
+#ifndef LCD_MAX_COLS
+#define LCD_MAX_COLS	40
+#endif
+#ifndef LCD_MAX_ROWS
+#define LCD_MAX_ROWS	4
+#endif
+
+//*****************************************************************************
+// Wait after power-up before the reset sequence, the datasheet asks 40ms
+// after Vcc rises above 2.7V
+//*****************************************************************************
+#ifndef LCD_POWERUP_US
+#define LCD_POWERUP_US	40000
+#endif
+
+//*****************************************************************************
+// DDRAM positions of a line in 2-line mode, visible or not. A module of
+// more than 80 characters (40x4) has two controllers of 2 lines each.
+//*****************************************************************************
+#define LCD_DDRAM_LINE	40
+#define LCD_DDRAM_CHARS	80
+#if LCD_MAX_COLS * LCD_MAX_ROWS > LCD_DDRAM_CHARS
+#define LCD_DDRAM_LINES	4
+#else
+#define LCD_DDRAM_LINES	2
+#endif
+
+//*****************************************************************************
+// Glyph cache, glyph IDs index the table given to Lcd_glyph_table
+//*****************************************************************************
+#define LCD_GLYPH_SLOTS	8		// CGRAM characters 0-7
+#define LCD_GLYPH_MAX	0xFE	// glyph IDs are 0 to LCD_GLYPH_MAX - 1
+
+//*****************************************************************************
+// Displays sharing the bus, one per PCF8574T address (0x20-0x27)
+//*****************************************************************************
+#ifndef LCD_MAX_DEVICES
+#define LCD_MAX_DEVICES	8
+#endif
+
+//*****************************************************************************
+// Screen field bound to a value, refreshed by Lcd_service. The members are
+// private to the driver.
+//*****************************************************************************
+#define LCD_FIELD_LONG		0x00	// value is a long, format with %ld %lu %lx
+#define LCD_FIELD_FLOAT		0x01	// value is a float, format with %f
+
+typedef struct tLcdField
+{
+	unsigned char x;
+	unsigned char y;
+	unsigned char width;			// cells, the text is padded or cut to it
+	unsigned char type;
+	const char *format;				// a single conversion taking the value
+	const volatile void *value;
+	long (*fnValue)(void);			// read instead of value when set, long only
+	unsigned long interval;			// least time between two refreshes
+	unsigned long last;				// time of the last refresh
+	unsigned long shown;			// value on screen
+	unsigned char valid;			// shown and last are set
+	struct tLcdField *next;
+} tLcdField;
+
+//*****************************************************************************
+// Screen window with its own back buffer, composed by z order, see
+// i2c_lcd_window.c. The members are private to the driver.
+//*****************************************************************************
+#ifndef LCD_WINDOW_CELLS
+#define LCD_WINDOW_CELLS	80
+#endif
+
+typedef struct tLcdWindow
+{
+	unsigned char x;
+	unsigned char y;
+	unsigned char cols;
+	unsigned char rows;
+	unsigned char z;				// higher windows cover lower ones
+	unsigned char visible;
+	unsigned char dirty;			// cells changed since the last compose
+	unsigned char curx;
+	unsigned char cury;
+	unsigned char cells[LCD_WINDOW_CELLS];
+	struct tLcdWindow *next;		// next lower window
+} tLcdWindow;
+
+//*****************************************************************************
+// Character ROM of the lcd, selects the UTF-8 translation of the text
+//*****************************************************************************
+#define LCD_ROM_RAW		0x00	// no translation, bytes are character codes
+#define LCD_ROM_A00		0x01	// Japanese standard font
+#define LCD_ROM_A02		0x02	// European standard font
+#define LCD_UTF8_MAX	3		// bytes of the longest translated sequence
+
+//*****************************************************************************
+// Display handle, the members are private to the driver
+//*****************************************************************************
+typedef struct
+{
+	unsigned char addr;				// PCF8574T 7-bit address
+	unsigned char cols;
+	unsigned char rows;
+	unsigned char backlightval;
+	unsigned char busyMode;
+	unsigned char expState;			// last state written to the expander
+	// what the application wants on screen and what the DDRAM holds
+	unsigned char fb[LCD_MAX_ROWS][LCD_MAX_COLS];
+	unsigned short ddram[LCD_DDRAM_LINES][LCD_DDRAM_LINE];
+	unsigned char shift;			// display shift, first visible position
+	unsigned char entryShift;		// entry mode shifts the display on writes
+	unsigned char fbMode;
+	unsigned char curx;
+	unsigned char cury;
+	unsigned char hwAddr;			// DDRAM address counter, bit 7 the controller
+	unsigned char dual;				// two controllers, the second one on E2
+	unsigned char ctrl;				// controller receiving DDRAM data
+	unsigned char cgram;			// data goes to CGRAM, of both controllers
+	unsigned char wrap;				// text continues on the next row
+	unsigned char entryLeft;
+	unsigned char rom;				// character ROM, LCD_ROM_RAW sends bytes as is
+	unsigned char hardClear;		// always send the clear and home commands
+	unsigned char displayCtl;		// last display control command
+	// DDRAM read back by Lcd_service, cells a call, 0 turns it off
+	unsigned char verifyCells;
+	unsigned char verifyAddr;		// next DDRAM address to check
+	unsigned long readyAt;			// clock time the lcd accepts the next write
+	// asynchronous transmit queue, the volatile members are shared with
+	// Lcd_queue_service running from the I2C and timer interrupts
+	unsigned short queue[LCD_QUEUE_SIZE];
+	volatile unsigned short qHead;
+	volatile unsigned short qTail;
+	unsigned short qWrite;
+	unsigned char qOverflow;
+	volatile unsigned long qWaitUs;	// time left before the display is ready
+	// glyph cache, glyph held by each CGRAM slot and when it was last used
+	unsigned char glyphId[LCD_GLYPH_SLOTS];
+	unsigned long glyphUse[LCD_GLYPH_SLOTS];
+	unsigned long glyphClock;
+	// marquee text of each row, NULL for static rows
+	const char *marquee[LCD_MAX_ROWS];
+	unsigned short marqueeLen[LCD_MAX_ROWS];
+	unsigned short marqueePos[LCD_MAX_ROWS];
+	tLcdField *fields;
+	tLcdWindow *windows;			// highest z first
+	// coalescing refresh, Lcd_service flushes at most once a frame
+	unsigned long framePeriod;		// microseconds, 0 flushes on every call
+	unsigned long frameLast;
+	unsigned char frameDirty;		// fields changed since the last flush
+	// backlight switched off by Lcd_service after a time without new cells
+	unsigned long idleTimeout;		// milliseconds, 0 keeps it on
+	unsigned long activeAt;			// time of the last Lcd_service after new cells
+	unsigned char idleActive;		// cells written since the last Lcd_service
+	unsigned char idleDark;			// the timeout switched the backlight off
+	// non-blocking initialization
+	unsigned char initStep;
+	unsigned long initWaitUs;
+} tLcd;
+
+//*****************************************************************************
+// Bar graph and big number widgets, i2c_lcd_widget.c
+//*****************************************************************************
+#define LCD_BAR_HORIZONTAL	0x00
+#define LCD_BAR_VERTICAL	0x01
+#define LCD_BIGNUM			0x02
+#ifndef LCD_WIDGET_CELLS
+#define LCD_WIDGET_CELLS	40
+#endif
+
+typedef struct
+{
+	unsigned char type;
+	unsigned char x;
+	unsigned char y;
+	unsigned char len;				// bar cells or number digits
+	unsigned char cells;
+	unsigned char slot;				// first CGRAM location
+	unsigned char valid;			// drawn[] matches the display
+	unsigned char drawn[LCD_WIDGET_CELLS];
+} tLcdWidget;
+
+//*****************************************************************************
+// Multi-producer display queue, i2c_lcd_task.c. Requests posted by any task
+// wait in a ring of LCD_POST_SIZE slots (a power of 2) for the display task.
+//*****************************************************************************
+#ifndef LCD_POST_SIZE
+#define LCD_POST_SIZE		32
+#endif
+#ifndef LCD_POST_TEXT_SIZE
+#define LCD_POST_TEXT_SIZE	(LCD_MAX_COLS + 1)
+#endif
+
+//*****************************************************************************
+// Instrumentation, compiled in when LCD_STATS is defined for the whole
+// project. Call times go into log2 buckets of microseconds, bucket 0 holds
+// the calls under 2us and bucket n those from 2^n to 2^(n+1)-1 us.
+//*****************************************************************************
+#define LCD_STAT_INIT		0
+#define LCD_STAT_CLEAR		1
+#define LCD_STAT_HOME		2
+#define LCD_STAT_GOTOXY		3
+#define LCD_STAT_PRINT		4
+#define LCD_STAT_MESSAGE	5
+#define LCD_STAT_CREATECHAR	6
+#define LCD_STAT_FLUSH		7
+#define LCD_STAT_SERVICE	8
+#define LCD_STAT_CALLS		9
+#define LCD_STAT_BUCKETS	16
+
+typedef struct
+{
+	unsigned long transactions;		// I2C writes and reads
+	unsigned long bytes;
+	unsigned long failures;			// transactions that returned an error
+	unsigned long waitUs;			// time spent waiting for the lcd
+	unsigned short queueMax;		// deepest asynchronous queue seen
+	unsigned long activeUs;			// CPU time in the calls, sleeps excluded
+	unsigned long sleepUs;			// time the clock sleep function slept
+	unsigned long frames;			// flushes that sent at least one cell
+	unsigned long repairs;			// cells read back wrong and rewritten
+	unsigned long resyncs;			// 4-bit sync lost and restored
+	unsigned long calls[LCD_STAT_CALLS];
+	unsigned long totalUs[LCD_STAT_CALLS];
+	unsigned long maxUs[LCD_STAT_CALLS];
+	unsigned long hist[LCD_STAT_CALLS][LCD_STAT_BUCKETS];
+} tLcdStats;
+
+//*****************************************************************************
+// Bus trace, compiled in when LCD_TRACE is defined for the whole project.
+// A RAM ring of LCD_TRACE_SIZE bytes keeps the newest records, see
+// Lcd_trace_dump for the format and Host/lcd_replay.c to replay it.
+//*****************************************************************************
+#ifndef LCD_TRACE_SIZE
+#define LCD_TRACE_SIZE		2048
+#endif
+#define LCD_TRACE_WRITE		0x01	// I2C write, address and expander states
+#define LCD_TRACE_READ		0x02	// I2C read, address and pins
+#define LCD_TRACE_WAIT		0x03	// wait for the lcd in microseconds
 
 //*****************************************************************************
 //
@@ -116,6 +402,13 @@ unsigned char _rows;
 //
 //*****************************************************************************
 	void Lcd_init(unsigned char cols, unsigned char rows);
+	void Lcd_init_start(unsigned char cols, unsigned char rows);
+	unsigned long Lcd_init_tick(unsigned long ulElapsedUs);
+	unsigned long Lcd_snapshot();
+	int  Lcd_resume(unsigned long ulSnapshot);
+	int  Lcd_open(tLcd *pLcd, unsigned char ucAddr);
+	int  Lcd_select(tLcd *pLcd);
+	tLcd *Lcd_selected();
 /********** high level commands*/
 	void Lcd_clear();
 	void Lcd_home();
@@ -123,15 +416,106 @@ unsigned char _rows;
 	void Lcd_displaycontrol(unsigned char display, unsigned char cursor, unsigned char blink);
 	void Lcd_cursorshift(unsigned char move, unsigned char direction);
 	void Lcd_gotoxy(unsigned char xCoor, unsigned char yCoor);
+	void Lcd_wrap(unsigned char value);
+	int  Lcd_marquee(unsigned char row, const char *pcText);
+	int  Lcd_marquee_step();
+	int  Lcd_field_add(tLcdField *pField, unsigned char x, unsigned char y,
+			unsigned char width, const char *pcFormat, unsigned char ucType,
+			const volatile void *pvValue, unsigned long ulInterval);
+	int Lcd_field_callback(tLcdField *pField, long (*pfnValue)(void));
+	void Lcd_field_remove(tLcdField *pField);
+	void Lcd_field_clock(unsigned long (*pfnMillis)(void));
+	int  Lcd_service();
+	void Lcd_refresh_rate(unsigned char ucHz);
 	void Lcd_createChar(unsigned char location, unsigned char charmap[]);
+	void Lcd_glyph_table(const unsigned char (*pucTable)[8], unsigned char ucCount);
+	int  Lcd_glyph_load(const unsigned char *pucIds, unsigned char ucCount);
+	int  Lcd_glyph(unsigned char ucId);
+	void Lcd_glyph_codes(const unsigned short *pusCodes);
+	void Lcd_rom(unsigned char ucRom);
 	void Lcd_backlight(unsigned char value);
+	void Lcd_backlight_timeout(unsigned long ulMs);
+	void Lcd_verify(unsigned char ucCells);
+	int  Lcd_verify_step();
 	int  Lcd_Print(const char *pcFormat, ...);
+	int  Lcd_vformat(char *pcBuf, int iSize, const char *pcFormat, va_list list);
 	void Lcd_message(const char *str);
+	void Lcd_burst_begin();
+	int  Lcd_burst_end();
+	void Lcd_putc(unsigned char c);
+	void Lcd_framebuffer(unsigned char value);
+	int  Lcd_flush();
+	void Lcd_busyflag(unsigned char value);
+	void Lcd_softclear(unsigned char value);
+	void Lcd_clock(const tLcdClock *pClock);
+	unsigned long Lcd_micros();
+	void Lcd_wait_until(unsigned long ulDeadline);
+	int  Lcd_ready();
+
+/************ asynchronous transmit queue **********/
+	void Lcd_async(unsigned char value);
+	void Lcd_queue_port(const tLcdPort *port);
+	int  Lcd_queue_free();
+	int  Lcd_queue_service();
+	void Lcd_queue_done();
+	void Lcd_bus_speed(unsigned long ulHz);
+	void Lcd_bus_budget(unsigned char ucStates);
 
 /************ low level data pushing commands **********/
 	void Lcd_send_command(unsigned char value);
 	void Lcd_send_byte(unsigned char value, unsigned char mode);
 	int Lcd_WriteI2C(unsigned char _data);
+
+#ifdef LCD_STATS
+/************ instrumentation **********/
+	void Lcd_stats_clock(unsigned long (*pfnTicks)(void), unsigned long ulTicksPerUs);
+	const tLcdStats *Lcd_stats();
+	void Lcd_stats_reset();
+	void Lcd_stats_dump();
+#endif
+
+#ifdef LCD_TRACE
+/************ bus trace **********/
+	void Lcd_trace(unsigned char value);
+	unsigned int Lcd_trace_read(unsigned char *pucBuf, unsigned int uiSize);
+	void Lcd_trace_dump();
+#endif
+
+/************ interrupt driven port, i2c_lcd_port.c **********/
+	void Lcd_port_init();
+	void Lcd_port_clock_init();
+	void Lcd_port_sleep_init();
+#ifdef LCD_STATS
+	void Lcd_port_stats_init();
+#endif
+
+/************ multi-task posting, i2c_lcd_task.c **********/
+	int  Lcd_post_text(tLcd *pLcd, unsigned char x, unsigned char y, const char *pcText);
+	int  Lcd_post_printf(tLcd *pLcd, unsigned char x, unsigned char y,
+			const char *pcFormat, ...);
+	int  Lcd_post_clear(tLcd *pLcd);
+	int  Lcd_post_backlight(tLcd *pLcd, unsigned char value);
+	int  Lcd_post_call(tLcd *pLcd, void (*pfnCall)(void *pvArg), void *pvArg);
+	void Lcd_post_notify(void (*pfnNotify)(void));
+	int  Lcd_post_service();
+
+/************ windows, i2c_lcd_window.c **********/
+	int  Lcd_window_open(tLcdWindow *pWin, unsigned char x, unsigned char y,
+			unsigned char cols, unsigned char rows, unsigned char z);
+	void Lcd_window_close(tLcdWindow *pWin);
+	void Lcd_window_show(tLcdWindow *pWin, unsigned char value);
+	void Lcd_window_clear(tLcdWindow *pWin);
+	void Lcd_window_gotoxy(tLcdWindow *pWin, unsigned char x, unsigned char y);
+	int  Lcd_window_print(tLcdWindow *pWin, const char *pcFormat, ...);
+	int  Lcd_window_compose();
+
+/************ widgets, i2c_lcd_widget.c **********/
+	int  Lcd_bar_create(tLcdWidget *pWidget, unsigned char ucType, unsigned char x,
+			unsigned char y, unsigned char len, unsigned char ucSlot);
+	int  Lcd_bar_set(tLcdWidget *pWidget, unsigned long ulValue, unsigned long ulMax);
+	int  Lcd_bignum_create(tLcdWidget *pWidget, unsigned char x, unsigned char y,
+			unsigned char ucDigits, unsigned char ucSlot);
+	int  Lcd_bignum_set(tLcdWidget *pWidget, unsigned long ulValue);
 //*****************************************************************************
 //
 // Mark the end of the C bindings section for C++ compilers.
@@ -0,0 +1,366 @@
+/*
+ * i2c_lcd_port.c
+ *
+ *  Interrupt driven transmit port for the i2c_lcd asynchronous queue
+ *
+ *      The I2C master data interrupt feeds the expander states of a queued
+ *      segment one by one, and TIMERA3 in one-shot mode times the waits
+ *      between commands, so Lcd_async(ENABLE) never blocks the CPU.
+ *
+ *      Usage:
+ *          I2C_IF_Open(I2C_MASTER_MODE_STD);
+ *          Lcd_port_init();
+ *          Lcd_async(ENABLE);
+ *
+ *      While the port is active it owns the I2C interrupt, other devices on
+ *      the bus should not use I2C_IF_Write/I2C_IF_Read at the same time.
+ *
+ *      Lcd_port_clock_init runs TIMERA2 as a free running counter and gives
+ *      the driver a microsecond clock for the command gaps (Lcd_clock).
+ *      Lcd_port_sleep_init does the same and puts the CPU in sleep mode
+ *      through the longer gaps (clear, home, init), woken by a TIMERA2
+ *      match, instead of spinning on the counter.
+ */
+//*****************************************************************************
+//
+//! @{
+//
+//*****************************************************************************
+// Driverlib includes
+#include "hw_types.h"
+#include "hw_ints.h"
+#include "hw_memmap.h"
+#include "hw_timer.h"
+#include "interrupt.h"
+#include "i2c.h"
+#include "timer.h"
+#include "prcm.h"
+#include "rom.h"
+#include "rom_map.h"
+
+#include "i2c_lcd.h"
+#include "uart_if.h"
+
+//*****************************************************************************
+//                      MACRO DEFINITIONS
+//*****************************************************************************
+#define SUCCESS                 0
+#define DBG_PRINT               Report
+#define LCD_I2C_BASE            I2CA0_BASE
+#define LCD_I2C_INT             INT_I2CA0
+#define LCD_TIMER_BASE          TIMERA3_BASE
+#define LCD_TIMER_INT           INT_TIMERA3A
+#define LCD_TIMER_TICKS_PER_US  80
+#define LCD_CLOCK_BASE          TIMERA2_BASE
+// shorter gaps are spun, entering and leaving sleep takes a few microseconds
+#define LCD_SLEEP_MIN_US        20
+// Cortex-M4 debug registers of the cycle counter
+#define LCD_DEMCR               0xE000EDFC
+#define LCD_DEMCR_TRCENA        0x01000000
+#define LCD_DWT_CTRL            0xE0001000
+#define LCD_DWT_CYCCNTENA       0x00000001
+#define LCD_DWT_CYCCNT          0xE0001004
+
+//*****************************************************************************
+//                      LOCAL VARIABLES
+//*****************************************************************************
+static unsigned char *_pucTx;
+static unsigned char _ucTxLen;
+static volatile unsigned char _ucTxIdx;
+// software extension of the TIMERA2 count
+static unsigned long _ulClockLast;
+static unsigned long _ulClockTicks;
+static unsigned long _ulClockMicros;
+
+//****************************************************************************
+//                      LOCAL FUNCTION DEFINITIONS
+//****************************************************************************
+
+//****************************************************************************
+//
+//! Start an I2C write
+//!
+//! \param ucAddr: 7-bit device address
+//! \param pucData: expander states, must stay valid until Lcd_queue_done
+//! \param ucLen: number of states
+//!
+//! This function
+//!    1. Puts the first state and starts a single or burst send, the data
+//!		  interrupt sends the rest
+//!
+//! \return success
+//
+//****************************************************************************
+static int Lcd_port_write(unsigned char ucAddr, unsigned char *pucData,
+		unsigned char ucLen) {
+	_pucTx = pucData;
+	_ucTxLen = ucLen;
+	_ucTxIdx = 1;
+	MAP_I2CMasterIntClearEx(LCD_I2C_BASE,
+			MAP_I2CMasterIntStatusEx(LCD_I2C_BASE, false));
+	MAP_I2CMasterSlaveAddrSet(LCD_I2C_BASE, ucAddr, false);
+	MAP_I2CMasterDataPut(LCD_I2C_BASE, pucData[0]);
+	MAP_I2CMasterControl(LCD_I2C_BASE, (ucLen == 1) ?
+			I2C_MASTER_CMD_SINGLE_SEND : I2C_MASTER_CMD_BURST_SEND_START);
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Start a wait
+//!
+//! \param ulMicros: microseconds before Lcd_queue_done is called
+//!
+//****************************************************************************
+static void Lcd_port_wait(unsigned long ulMicros) {
+	if (ulMicros == 0) {
+		ulMicros = 1;
+	}
+	MAP_TimerLoadSet(LCD_TIMER_BASE, TIMER_A,
+			ulMicros * LCD_TIMER_TICKS_PER_US);
+	MAP_TimerEnable(LCD_TIMER_BASE, TIMER_A);
+}
+
+//****************************************************************************
+//
+//! Start draining the queue from thread context
+//!
+//****************************************************************************
+static void Lcd_port_kick() {
+	MAP_IntDisable(LCD_I2C_INT);
+	MAP_IntDisable(LCD_TIMER_INT);
+	Lcd_queue_service();
+	MAP_IntEnable(LCD_TIMER_INT);
+	MAP_IntEnable(LCD_I2C_INT);
+}
+
+//****************************************************************************
+//
+//! I2C master interrupt handler
+//!
+//! This function
+//!    1. Sends the next expander state of the segment, or finishes it
+//!    2. Stops the burst and drops the segment on a NACK or timeout
+//!
+//****************************************************************************
+static void Lcd_port_i2c_handler() {
+	unsigned long ulStatus = MAP_I2CMasterIntStatusEx(LCD_I2C_BASE, true);
+	MAP_I2CMasterIntClearEx(LCD_I2C_BASE, ulStatus);
+
+	if (ulStatus & (I2C_MASTER_INT_NACK | I2C_MASTER_INT_TIMEOUT)) {
+		if (_ucTxLen > 1) {
+			MAP_I2CMasterControl(LCD_I2C_BASE,
+					I2C_MASTER_CMD_BURST_SEND_ERROR_STOP);
+		}
+		DBG_PRINT("I2C queue write failed\n\r");
+		Lcd_queue_done();
+		return;
+	}
+	if (!(ulStatus & I2C_MASTER_INT_DATA)) {
+		return;
+	}
+	if (_ucTxIdx < _ucTxLen) {
+		MAP_I2CMasterDataPut(LCD_I2C_BASE, _pucTx[_ucTxIdx++]);
+		MAP_I2CMasterControl(LCD_I2C_BASE, (_ucTxIdx == _ucTxLen) ?
+				I2C_MASTER_CMD_BURST_SEND_FINISH : I2C_MASTER_CMD_BURST_SEND_CONT);
+		return;
+	}
+	Lcd_queue_done();
+}
+
+//****************************************************************************
+//
+//! Wait timer interrupt handler
+//!
+//****************************************************************************
+static void Lcd_port_timer_handler() {
+	MAP_TimerIntClear(LCD_TIMER_BASE, TIMER_TIMA_TIMEOUT);
+	Lcd_queue_done();
+}
+
+static const tLcdPort _intPort = {
+	Lcd_port_write,
+	Lcd_port_wait,
+	Lcd_port_kick
+};
+
+//****************************************************************************
+//
+//! Read the microsecond clock
+//!
+//! This function
+//!    1. Adds the timer ticks since the last call, the 32-bit counter wraps
+//!		  every 53s so it must be read at least that often
+//!    2. Converts whole microseconds and keeps the remaining ticks
+//!
+//! \return free running microsecond count
+//
+//****************************************************************************
+static unsigned long Lcd_port_micros() {
+	unsigned long ulNow = MAP_TimerValueGet(LCD_CLOCK_BASE, TIMER_A);
+	_ulClockTicks += ulNow - _ulClockLast;
+	_ulClockLast = ulNow;
+	_ulClockMicros += _ulClockTicks / LCD_TIMER_TICKS_PER_US;
+	_ulClockTicks %= LCD_TIMER_TICKS_PER_US;
+	return _ulClockMicros;
+}
+
+// no sleep function, the gaps are a few microseconds and Lcd_wait_until spins
+static const tLcdClock _timerClock = {
+	Lcd_port_micros,
+	NULL
+};
+
+//****************************************************************************
+//
+//! Clock match interrupt handler, only wakes the CPU up
+//!
+//****************************************************************************
+static void Lcd_port_clock_handler() {
+	MAP_TimerIntClear(LCD_CLOCK_BASE, TIMER_TIMA_MATCH);
+}
+
+//****************************************************************************
+//
+//! Sleep through a gap
+//!
+//! \param ulMicros: microseconds left of the gap
+//!
+//! This function
+//!    1. Sets the TIMERA2 match to the end of the gap and enters sleep mode,
+//!		  any other interrupt may wake the CPU earlier, Lcd_wait_until then
+//!		  sleeps again for what is left
+//!    2. Returns at once for short gaps
+//!
+//! \Note: interrupts are masked while the match is set, so a match before
+//!		   the WFI leaves it pending and the CPU does not sleep.
+//
+//****************************************************************************
+static void Lcd_port_sleep(unsigned long ulMicros) {
+	if (ulMicros < LCD_SLEEP_MIN_US)
+		return;
+	MAP_IntMasterDisable();
+	MAP_TimerMatchSet(LCD_CLOCK_BASE, TIMER_A,
+			MAP_TimerValueGet(LCD_CLOCK_BASE, TIMER_A)
+					+ ulMicros * LCD_TIMER_TICKS_PER_US);
+	MAP_TimerIntClear(LCD_CLOCK_BASE, TIMER_TIMA_MATCH);
+	MAP_TimerIntEnable(LCD_CLOCK_BASE, TIMER_TIMA_MATCH);
+	MAP_PRCMSleepEnter();
+	MAP_TimerIntDisable(LCD_CLOCK_BASE, TIMER_TIMA_MATCH);
+	MAP_IntMasterEnable();
+}
+
+static const tLcdClock _sleepClock = {
+	Lcd_port_micros,
+	Lcd_port_sleep
+};
+
+//****************************************************************************
+//
+//! Initialize the interrupt driven port
+//!
+//! This function
+//!    1. Configures TIMERA3 as a one-shot wait timer
+//!    2. Registers the I2C and timer interrupt handlers
+//!    3. Sets the port as the lcd queue transmit port
+//!
+//! \Note: I2C_IF_Open must be called first to configure the bus speed.
+//!
+//****************************************************************************
+void Lcd_port_init() {
+	MAP_PRCMPeripheralClkEnable(PRCM_TIMERA3, PRCM_RUN_MODE_CLK);
+	MAP_PRCMPeripheralReset(PRCM_TIMERA3);
+	MAP_TimerConfigure(LCD_TIMER_BASE, TIMER_CFG_ONE_SHOT);
+	MAP_TimerIntRegister(LCD_TIMER_BASE, TIMER_A, Lcd_port_timer_handler);
+	MAP_TimerIntEnable(LCD_TIMER_BASE, TIMER_TIMA_TIMEOUT);
+
+	MAP_I2CIntRegister(LCD_I2C_BASE, Lcd_port_i2c_handler);
+	MAP_I2CMasterIntEnableEx(LCD_I2C_BASE, I2C_MASTER_INT_DATA |
+			I2C_MASTER_INT_NACK | I2C_MASTER_INT_TIMEOUT);
+
+	Lcd_queue_port(&_intPort);
+}
+
+//****************************************************************************
+//
+//! Initialize the microsecond clock
+//!
+//! This function
+//!    1. Configures TIMERA2 as a periodic up counter over the whole 32-bit
+//!		  range at the 80MHz system clock
+//!    2. Sets it as the lcd clock, replacing the UtilsDelay cycle estimates
+//!
+//! \Note: Lcd_port_micros is not reentrant, the clock must be read from
+//!		   thread context only.
+//!
+//****************************************************************************
+void Lcd_port_clock_init() {
+	MAP_PRCMPeripheralClkEnable(PRCM_TIMERA2, PRCM_RUN_MODE_CLK);
+	MAP_PRCMPeripheralReset(PRCM_TIMERA2);
+	MAP_TimerConfigure(LCD_CLOCK_BASE, TIMER_CFG_PERIODIC_UP);
+	MAP_TimerLoadSet(LCD_CLOCK_BASE, TIMER_A, 0xFFFFFFFF);
+	MAP_TimerEnable(LCD_CLOCK_BASE, TIMER_A);
+	_ulClockLast = MAP_TimerValueGet(LCD_CLOCK_BASE, TIMER_A);
+	_ulClockTicks = 0;
+	Lcd_clock(&_timerClock);
+}
+
+//****************************************************************************
+//
+//! Initialize the microsecond clock with sleeping gaps
+//!
+//! This function
+//!    1. Starts the TIMERA2 clock as Lcd_port_clock_init
+//!    2. Keeps TIMERA2 and the I2C module clocked in sleep mode and enables
+//!		  the match interrupt of the counter
+//!    3. Sets a clock whose sleep function lets Lcd_wait_until sleep
+//!
+//! \Note: the asynchronous queue never waits in the caller, there the
+//!		   application sleeps itself while the port interrupts work.
+//!
+//****************************************************************************
+void Lcd_port_sleep_init() {
+	Lcd_port_clock_init();
+	MAP_PRCMPeripheralClkEnable(PRCM_TIMERA2,
+			PRCM_RUN_MODE_CLK | PRCM_SLP_MODE_CLK);
+	MAP_PRCMPeripheralClkEnable(PRCM_I2CA0,
+			PRCM_RUN_MODE_CLK | PRCM_SLP_MODE_CLK);
+	HWREG(LCD_CLOCK_BASE + TIMER_O_TAMR) |= TIMER_TAMR_TAMIE;
+	MAP_TimerIntRegister(LCD_CLOCK_BASE, TIMER_A, Lcd_port_clock_handler);
+	Lcd_clock(&_sleepClock);
+}
+
+#ifdef LCD_STATS
+//****************************************************************************
+//
+//! Read the DWT cycle counter
+//!
+//****************************************************************************
+static unsigned long Lcd_port_cycles() {
+	return HWREG(LCD_DWT_CYCCNT);
+}
+
+//****************************************************************************
+//
+//! Time the instrumentation with the DWT cycle counter
+//!
+//! This function
+//!    1. Enables the trace block and the cycle counter of the Cortex-M4
+//!    2. Sets it as the Lcd_stats clock, 80 cycles a microsecond
+//!
+//! \Note: a debugger may use the counter too, it is never reset here.
+//!
+//****************************************************************************
+void Lcd_port_stats_init() {
+	HWREG(LCD_DEMCR) |= LCD_DEMCR_TRCENA;
+	HWREG(LCD_DWT_CTRL) |= LCD_DWT_CYCCNTENA;
+	Lcd_stats_clock(Lcd_port_cycles, LCD_TIMER_TICKS_PER_US);
+}
+#endif
+
+//*****************************************************************************
+//
+// Close the Doxygen group.
+//! @}
+//
+//*****************************************************************************
@@ -0,0 +1,340 @@
+/*
+ * i2c_lcd_task.c
+ *
+ *  Multi-producer display queue for the i2c_lcd library
+ *
+ *      The driver keeps global state and is not reentrant, two tasks
+ *      printing at the same time interleave their nibbles and the lcd loses
+ *      the 4-bit sync. Here any number of tasks or interrupts post complete
+ *      requests (text at a position, clear, backlight, a callback) into a
+ *      lock-free ring, and a single display task runs them with the usual
+ *      Lcd_ calls. Posting never blocks and never touches the I2C bus.
+ *
+ *      Usage, TI-RTOS (FreeRTOS is the same with its semaphore calls):
+ *          Lcd_post_notify(WakeDisplayTask);     // Semaphore_post
+ *
+ *          DisplayTask:
+ *              Lcd_init(16,2);
+ *              while(1) {
+ *                  Semaphore_pend(displaySem, BIOS_WAIT_FOREVER);
+ *                  Lcd_post_service();
+ *              }
+ *
+ *          NetworkTask:
+ *              Lcd_post_printf(NULL, 0, 1, "IP %d.%d", ip[2], ip[3]);
+ *
+ *      Once posting is used only the display task may call the Lcd_
+ *      functions directly.
+ *
+ *      The ring is the bounded queue of D. Vyukov: each slot carries a
+ *      sequence number, producers claim a position with a compare and swap
+ *      and the consumer never needs one. LCD_CAS and LCD_BARRIER default to
+ *      the GCC __sync builtins (LDREX/STREX and DMB on the Cortex-M4), a
+ *      toolchain without them can define both with its own primitives.
+ */
+//*****************************************************************************
+//
+//! @{
+//
+//*****************************************************************************
+#include <stdarg.h>
+#include <string.h>
+
+#include "i2c_lcd.h"
+
+//*****************************************************************************
+//                      MACRO DEFINITIONS
+//*****************************************************************************
+#define SUCCESS                 0
+#define FAILURE                 -1
+#define LCD_POST_MASK           (LCD_POST_SIZE - 1)
+#define LCD_POST_TEXT           0
+#define LCD_POST_CLEAR          1
+#define LCD_POST_BACKLIGHT      2
+#define LCD_POST_CALL           3
+#ifndef LCD_CAS
+#define LCD_CAS(ptr, old, new)  __sync_bool_compare_and_swap((ptr), (old), (new))
+#endif
+#ifndef LCD_BARRIER
+#define LCD_BARRIER()           __sync_synchronize()
+#endif
+
+//*****************************************************************************
+//                      LOCAL TYPES
+//*****************************************************************************
+typedef struct
+{
+	// position the slot is free for, minus the slot index so that a zeroed
+	// ring is ready to use
+	volatile unsigned long seq;
+	tLcd *lcd;
+	unsigned char op;
+	unsigned char x;
+	unsigned char y;
+	char text[LCD_POST_TEXT_SIZE];
+	void (*pfnCall)(void *pvArg);
+	void *pvArg;
+} tLcdPost;
+
+//*****************************************************************************
+//                      LOCAL VARIABLES
+//*****************************************************************************
+static tLcdPost _post[LCD_POST_SIZE];
+static volatile unsigned long _postEnq = 0;
+static unsigned long _postDeq = 0;
+static void (*_postNotify)(void) = NULL;
+
+//****************************************************************************
+//                      LOCAL FUNCTION DEFINITIONS
+//****************************************************************************
+
+//****************************************************************************
+//
+//! Claim a free slot
+//!
+//! \param pulPos: returns the ring position of the slot
+//!
+//! \return the slot, or NULL when the ring is full
+//
+//****************************************************************************
+static tLcdPost *Lcd_post_claim(unsigned long *pulPos) {
+	unsigned long ulPos;
+	tLcdPost *pSlot;
+	long lDiff;
+
+	for (;;) {
+		ulPos = _postEnq;
+		pSlot = &_post[ulPos & LCD_POST_MASK];
+		lDiff = (long)(pSlot->seq + (ulPos & LCD_POST_MASK) - ulPos);
+		if (lDiff == 0) {
+			if (LCD_CAS(&_postEnq, ulPos, ulPos + 1))
+				break;
+		} else if (lDiff < 0) {
+			// the consumer has not freed the slot of the previous lap
+			return NULL;
+		}
+		// another producer took the position, try the next one
+	}
+	*pulPos = ulPos;
+	return pSlot;
+}
+
+//****************************************************************************
+//
+//! Publish a filled slot
+//!
+//! This function
+//!    1. Hands the slot over to the consumer, after the stores filling it
+//!    2. Wakes up the display task
+//
+//****************************************************************************
+static void Lcd_post_publish(tLcdPost *pSlot, unsigned long ulPos) {
+	LCD_BARRIER();
+	pSlot->seq = ulPos + 1 - (ulPos & LCD_POST_MASK);
+	if (_postNotify != NULL)
+		_postNotify();
+}
+
+//****************************************************************************
+//
+//! Post a request without text
+//!
+//! \return LCD_QUEUE_FULL when the ring is full, success otherwise
+//
+//****************************************************************************
+static int Lcd_post_op(tLcd *pLcd, unsigned char ucOp, unsigned char ucValue,
+		void (*pfnCall)(void *pvArg), void *pvArg) {
+	unsigned long ulPos;
+	tLcdPost *pSlot = Lcd_post_claim(&ulPos);
+	if (pSlot == NULL)
+		return LCD_QUEUE_FULL;
+	pSlot->lcd = pLcd;
+	pSlot->op = ucOp;
+	pSlot->x = ucValue;
+	pSlot->pfnCall = pfnCall;
+	pSlot->pvArg = pvArg;
+	Lcd_post_publish(pSlot, ulPos);
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Post text at a position
+//!
+//! \param pLcd: display, NULL for the display at LCDI2C_ADDRESS
+//! \param x: column
+//! \param y: row
+//! \param pcText: text, cut at LCD_POST_TEXT_SIZE - 1 characters
+//!
+//! This function
+//!    1. Copies the text into a free slot, the caller's buffer can be
+//!		  reused at once
+//!
+//! \return failure when pcText is NULL, LCD_QUEUE_FULL when the ring is
+//!		   full, success otherwise
+//!
+//****************************************************************************
+int Lcd_post_text(tLcd *pLcd, unsigned char x, unsigned char y,
+		const char *pcText) {
+	unsigned long ulPos;
+	tLcdPost *pSlot;
+	if (pcText == NULL)
+		return FAILURE;
+	pSlot = Lcd_post_claim(&ulPos);
+	if (pSlot == NULL)
+		return LCD_QUEUE_FULL;
+	pSlot->lcd = pLcd;
+	pSlot->op = LCD_POST_TEXT;
+	pSlot->x = x;
+	pSlot->y = y;
+	strncpy(pSlot->text, pcText, LCD_POST_TEXT_SIZE - 1);
+	pSlot->text[LCD_POST_TEXT_SIZE - 1] = '\0';
+	Lcd_post_publish(pSlot, ulPos);
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Post formatted text at a position
+//!
+//! \param pLcd: display, NULL for the display at LCDI2C_ADDRESS
+//! \param x: column
+//! \param y: row
+//! \param pcFormat: Lcd_Print format
+//!
+//! This function
+//!    1. Formats with Lcd_vformat on the caller's stack, which uses no
+//!		  driver state and can run in any task
+//!    2. Posts the result as Lcd_post_text
+//!
+//! \return LCD_QUEUE_FULL when the ring is full, success otherwise
+//!
+//****************************************************************************
+int Lcd_post_printf(tLcd *pLcd, unsigned char x, unsigned char y,
+		const char *pcFormat, ...) {
+	char acBuff[LCD_POST_TEXT_SIZE];
+	va_list list;
+
+	va_start(list, pcFormat);
+	Lcd_vformat(acBuff, sizeof(acBuff), pcFormat, list);
+	va_end(list);
+	return Lcd_post_text(pLcd, x, y, acBuff);
+}
+
+//****************************************************************************
+//
+//! Post a clear
+//!
+//! \param pLcd: display, NULL for the display at LCDI2C_ADDRESS
+//!
+//! \return LCD_QUEUE_FULL when the ring is full, success otherwise
+//!
+//****************************************************************************
+int Lcd_post_clear(tLcd *pLcd) {
+	return Lcd_post_op(pLcd, LCD_POST_CLEAR, 0, NULL, NULL);
+}
+
+//****************************************************************************
+//
+//! Post a backlight change
+//!
+//! \param pLcd: display, NULL for the display at LCDI2C_ADDRESS
+//! \param value: ENABLE or DISABLE
+//!
+//! \return LCD_QUEUE_FULL when the ring is full, success otherwise
+//!
+//****************************************************************************
+int Lcd_post_backlight(tLcd *pLcd, unsigned char value) {
+	return Lcd_post_op(pLcd, LCD_POST_BACKLIGHT, value, NULL, NULL);
+}
+
+//****************************************************************************
+//
+//! Post a callback
+//!
+//! \param pLcd: display selected when the callback runs, NULL for the
+//!		   display at LCDI2C_ADDRESS
+//! \param pfnCall: function run by the display task, it may use any Lcd_
+//!		   function, e.g. to update a widget
+//! \param pvArg: argument of pfnCall
+//!
+//! \return failure when pfnCall is NULL, LCD_QUEUE_FULL when the ring is
+//!		   full, success otherwise
+//!
+//****************************************************************************
+int Lcd_post_call(tLcd *pLcd, void (*pfnCall)(void *pvArg), void *pvArg) {
+	// checked here, the display task would only find out when calling it
+	if (pfnCall == NULL)
+		return FAILURE;
+	return Lcd_post_op(pLcd, LCD_POST_CALL, 0, pfnCall, pvArg);
+}
+
+//****************************************************************************
+//
+//! Set the wake up function
+//!
+//! \param pfnNotify: called after every post, e.g. posting the semaphore
+//!		   the display task pends on. It runs in the posting context.
+//!
+//****************************************************************************
+void Lcd_post_notify(void (*pfnNotify)(void)) {
+	_postNotify = pfnNotify;
+}
+
+//****************************************************************************
+//
+//! Run the posted requests
+//!
+//! This function
+//!    1. Takes the published requests in order and runs each one on its
+//!		  display with the usual Lcd_ calls, then frees its slot
+//!    2. Selects the display that was selected before
+//!
+//! \return number of requests run
+//!
+//! \Note: must be called from one task only, the display task.
+//!
+//****************************************************************************
+int Lcd_post_service() {
+	tLcd *pSelected = Lcd_selected();
+	tLcdPost *pSlot;
+	unsigned long ulIdx;
+	int iCount = 0;
+
+	for (;;) {
+		ulIdx = _postDeq & LCD_POST_MASK;
+		pSlot = &_post[ulIdx];
+		if ((long)(pSlot->seq + ulIdx - (_postDeq + 1)) < 0)
+			break;
+		LCD_BARRIER();
+		Lcd_select(pSlot->lcd);
+		switch (pSlot->op) {
+		case LCD_POST_TEXT:
+			Lcd_gotoxy(pSlot->x, pSlot->y);
+			Lcd_message(pSlot->text);
+			break;
+		case LCD_POST_CLEAR:
+			Lcd_clear();
+			break;
+		case LCD_POST_BACKLIGHT:
+			Lcd_backlight(pSlot->x);
+			break;
+		default:
+			pSlot->pfnCall(pSlot->pvArg);
+			break;
+		}
+		LCD_BARRIER();
+		pSlot->seq = _postDeq + LCD_POST_SIZE - ulIdx;
+		_postDeq++;
+		iCount++;
+	}
+	Lcd_select(pSelected);
+	return iCount;
+}
+
+//*****************************************************************************
+//
+// Close the Doxygen group.
+//! @}
+//
+//*****************************************************************************
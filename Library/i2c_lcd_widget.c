@@ -0,0 +1,343 @@
+/*
+ * i2c_lcd_widget.c
+ *
+ *  Bar graph and big number widgets for the i2c_lcd library
+ *
+ *      The widgets draw with custom characters uploaded once, when they are
+ *      created, and remember the character of each of their cells so a new
+ *      value only sends the cells that changed.
+ *
+ *      Usage:
+ *          tLcdWidget bar;
+ *          Lcd_bar_create(&bar, LCD_BAR_HORIZONTAL, 0, 1, 16, 0);
+ *          Lcd_bar_set(&bar, CurrentLux, 1000);
+ *
+ *      CGRAM locations used from ucSlot on:
+ *          LCD_BAR_HORIZONTAL  4 (1 to 4 columns lit)
+ *          LCD_BAR_VERTICAL    7 (1 to 7 rows lit)
+ *          big number          3 (upper, lower and both bars)
+ *      Completely lit cells use the 0xFF block of the character ROM.
+ */
+//*****************************************************************************
+//
+//! @{
+//
+//*****************************************************************************
+#include <string.h>
+
+#include "i2c_lcd.h"
+
+//*****************************************************************************
+//                      MACRO DEFINITIONS
+//*****************************************************************************
+#define FAILURE                 -1
+#define SUCCESS                 0
+#define LCD_CHAR_FULL           0xFF    // ROM full block
+#define LCD_CHAR_EMPTY          ' '
+#define LCD_BIGNUM_UPPER        0       // glyphs from the big number slot
+#define LCD_BIGNUM_LOWER        1
+#define LCD_BIGNUM_BOTH         2
+#define LCD_BIGNUM_WIDTH        4       // 3 cells a digit and a gap
+
+//*****************************************************************************
+//                      LOCAL VARIABLES
+//*****************************************************************************
+static const unsigned char _bigGlyphs[3][8] = {
+	{ 0x1F, 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00 },
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F },
+	{ 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F }
+};
+
+// cells of each digit, upper row then lower row: U upper bar, L lower bar,
+// B both bars, F full block, ' ' blank
+static const char _bigDigits[10][7] = {
+	"FUFFLF", "UF LFL", "BBFFLL", "BBFLLF", "FLF  F",
+	"FBBLLF", "FBBFLF", "UUF  F", "FBFFLF", "FBFLLF"
+};
+
+//****************************************************************************
+//                      LOCAL FUNCTION DEFINITIONS
+//****************************************************************************
+
+//****************************************************************************
+//
+//! Screen position of a widget cell
+//!
+//! \param pWidget: widget
+//! \param ucCell: cell index
+//! \param pucX: returns the column
+//! \param pucY: returns the row
+//!
+//****************************************************************************
+static void Lcd_widget_cell(const tLcdWidget *pWidget, unsigned char ucCell,
+		unsigned char *pucX, unsigned char *pucY) {
+	switch (pWidget->type) {
+	case LCD_BAR_VERTICAL:
+		// cell 0 is the bottom one
+		*pucX = pWidget->x;
+		*pucY = pWidget->y + pWidget->len - 1 - ucCell;
+		break;
+	case LCD_BIGNUM:
+		// upper row of every digit, then the lower row
+		*pucX = pWidget->x + ucCell % (pWidget->len * LCD_BIGNUM_WIDTH);
+		*pucY = pWidget->y + ucCell / (pWidget->len * LCD_BIGNUM_WIDTH);
+		break;
+	default:
+		*pucX = pWidget->x + ucCell;
+		*pucY = pWidget->y;
+		break;
+	}
+}
+
+//****************************************************************************
+//
+//! Draw the cells that changed
+//!
+//! \param pWidget: widget
+//! \param pucCells: character of every cell
+//!
+//! This function
+//!    1. Sends the characters that differ from the last draw, moving the
+//!		  cursor only where the changed cells are not next to each other
+//!    2. Sends everything in a single burst
+//!
+//! \return LCD_QUEUE_FULL when the burst did not fit in the queue, then the
+//!		   next draw sends every cell, success otherwise
+//
+//****************************************************************************
+static int Lcd_widget_draw(tLcdWidget *pWidget, const unsigned char *pucCells) {
+	unsigned char ucNextX = 0xFF, ucNextY = 0xFF;
+	unsigned char x, y, i;
+	int iRet;
+
+	Lcd_burst_begin();
+	for (i = 0; i < pWidget->cells; i++) {
+		if (pWidget->valid && pWidget->drawn[i] == pucCells[i])
+			continue;
+		Lcd_widget_cell(pWidget, i, &x, &y);
+		if (x != ucNextX || y != ucNextY)
+			Lcd_gotoxy(x, y);
+		Lcd_putc(pucCells[i]);
+		ucNextX = x + 1;
+		ucNextY = y;
+	}
+	iRet = Lcd_burst_end();
+	if (iRet == LCD_QUEUE_FULL) {
+		pWidget->valid = 0;
+		return iRet;
+	}
+	memcpy(pWidget->drawn, pucCells, pWidget->cells);
+	pWidget->valid = 1;
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Upload the partial fill glyphs of a bar
+//!
+//! \param ucType: LCD_BAR_HORIZONTAL or LCD_BAR_VERTICAL
+//! \param ucSlot: first CGRAM location
+//!
+//****************************************************************************
+static void Lcd_bar_glyphs(unsigned char ucType, unsigned char ucSlot) {
+	unsigned char aucGlyph[8];
+	unsigned char i, row;
+
+	Lcd_burst_begin();
+	if (ucType == LCD_BAR_HORIZONTAL) {
+		// 1 to 4 columns lit from the left
+		for (i = 1; i < 5; i++) {
+			memset(aucGlyph, (0x1F << (5 - i)) & 0x1F, 8);
+			Lcd_createChar(ucSlot + i - 1, aucGlyph);
+		}
+	} else {
+		// 1 to 7 rows lit from the bottom
+		for (i = 1; i < 8; i++) {
+			for (row = 0; row < 8; row++)
+				aucGlyph[row] = (row >= 8 - i) ? 0x1F : 0x00;
+			Lcd_createChar(ucSlot + i - 1, aucGlyph);
+		}
+	}
+	Lcd_burst_end();
+}
+
+//****************************************************************************
+//
+//! Create a bar graph
+//!
+//! \param pWidget: widget, owned by the application
+//! \param ucType: LCD_BAR_HORIZONTAL grows to the right from x,
+//!		   LCD_BAR_VERTICAL grows up to y from y + len - 1
+//! \param x: column
+//! \param y: row
+//! \param len: cells, 5 steps each horizontally and 8 vertically
+//! \param ucSlot: first CGRAM location, 4 horizontal and 7 vertical are used
+//!
+//! This function
+//!    1. Uploads the partial fill glyphs to the selected display
+//!    2. Makes the first Lcd_bar_set draw every cell
+//!
+//! \return failure when the bar does not fit on the selected display or its
+//!		   glyphs in the CGRAM, success otherwise
+//
+//****************************************************************************
+int Lcd_bar_create(tLcdWidget *pWidget, unsigned char ucType, unsigned char x,
+		unsigned char y, unsigned char len, unsigned char ucSlot) {
+	const tLcd *pLcd = Lcd_selected();
+	unsigned char ucGlyphs = (ucType == LCD_BAR_HORIZONTAL) ? 4 : 7;
+
+	if (len == 0 || len > LCD_WIDGET_CELLS || ucSlot + ucGlyphs > 8
+			|| (ucType != LCD_BAR_HORIZONTAL && ucType != LCD_BAR_VERTICAL))
+		return FAILURE;
+	if ((ucType == LCD_BAR_HORIZONTAL) ?
+			x + len > pLcd->cols || y >= pLcd->rows :
+			x >= pLcd->cols || y + len > pLcd->rows)
+		return FAILURE;
+	pWidget->type = ucType;
+	pWidget->x = x;
+	pWidget->y = y;
+	pWidget->len = len;
+	pWidget->cells = len;
+	pWidget->slot = ucSlot;
+	pWidget->valid = 0;
+	Lcd_bar_glyphs(ucType, ucSlot);
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Set the value of a bar graph
+//!
+//! \param pWidget: widget created with Lcd_bar_create
+//! \param ulValue: value, clamped to ulMax
+//! \param ulMax: value of a full bar
+//!
+//! This function
+//!    1. Converts the value to lit columns or rows, rounding to the nearest
+//!    2. Sends the cells that changed to the selected display
+//!
+//! \return LCD_QUEUE_FULL when the update did not fit in the queue, success
+//!		   otherwise
+//
+//****************************************************************************
+int Lcd_bar_set(tLcdWidget *pWidget, unsigned long ulValue, unsigned long ulMax) {
+	unsigned char aucCells[LCD_WIDGET_CELLS];
+	unsigned char ucSteps = (pWidget->type == LCD_BAR_HORIZONTAL) ? 5 : 8;
+	unsigned long ulLit;
+	unsigned char i;
+
+	if (ulMax == 0)
+		ulMax = 1;
+	if (ulValue > ulMax)
+		ulValue = ulMax;
+	ulLit = ((unsigned long long)ulValue * pWidget->len * ucSteps + ulMax / 2)
+			/ ulMax;
+	for (i = 0; i < pWidget->len; i++) {
+		if (ulLit >= ucSteps) {
+			aucCells[i] = LCD_CHAR_FULL;
+			ulLit -= ucSteps;
+		} else if (ulLit == 0) {
+			aucCells[i] = LCD_CHAR_EMPTY;
+		} else {
+			aucCells[i] = pWidget->slot + ulLit - 1;
+			ulLit = 0;
+		}
+	}
+	return Lcd_widget_draw(pWidget, aucCells);
+}
+
+//****************************************************************************
+//
+//! Create a big number
+//!
+//! \param pWidget: widget, owned by the application
+//! \param x: column of the first digit
+//! \param y: upper row, the number takes y and y + 1
+//! \param ucDigits: digits, 4 columns each, 3 for the digit and a gap after
+//!		   it, so 4 digits fill a 16 column display
+//! \param ucSlot: first of the 3 CGRAM locations used
+//!
+//! This function
+//!    1. Uploads the digit glyphs to the selected display
+//!    2. Makes the first Lcd_bignum_set draw every cell
+//!
+//! \return failure when the number does not fit on the selected display or
+//!		   its glyphs in the CGRAM, success otherwise
+//
+//****************************************************************************
+int Lcd_bignum_create(tLcdWidget *pWidget, unsigned char x, unsigned char y,
+		unsigned char ucDigits, unsigned char ucSlot) {
+	const tLcd *pLcd = Lcd_selected();
+	unsigned char i;
+
+	if (ucDigits == 0 || ucDigits * LCD_BIGNUM_WIDTH * 2 > LCD_WIDGET_CELLS
+			|| ucSlot + 3 > 8)
+		return FAILURE;
+	if (x + ucDigits * LCD_BIGNUM_WIDTH > pLcd->cols || y + 2 > pLcd->rows)
+		return FAILURE;
+	pWidget->type = LCD_BIGNUM;
+	pWidget->x = x;
+	pWidget->y = y;
+	pWidget->len = ucDigits;
+	pWidget->cells = ucDigits * LCD_BIGNUM_WIDTH * 2;
+	pWidget->slot = ucSlot;
+	pWidget->valid = 0;
+	Lcd_burst_begin();
+	for (i = 0; i < 3; i++)
+		Lcd_createChar(ucSlot + i, (unsigned char *)_bigGlyphs[i]);
+	Lcd_burst_end();
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Set the value of a big number
+//!
+//! \param pWidget: widget created with Lcd_bignum_create
+//! \param ulValue: value, right aligned without leading zeros. The lowest
+//!		   digits are shown when it does not fit.
+//!
+//! This function
+//!    1. Sends the cells of the digits that changed to the selected display
+//!
+//! \return LCD_QUEUE_FULL when the update did not fit in the queue, success
+//!		   otherwise
+//
+//****************************************************************************
+int Lcd_bignum_set(tLcdWidget *pWidget, unsigned long ulValue) {
+	unsigned char aucCells[LCD_WIDGET_CELLS];
+	unsigned char ucRow = pWidget->len * LCD_BIGNUM_WIDTH;
+	unsigned char ucDigit = pWidget->len;
+	unsigned char i, row, base;
+	const char *pcCells;
+
+	memset(aucCells, LCD_CHAR_EMPTY, pWidget->cells);
+	do {
+		ucDigit--;
+		base = ucDigit * LCD_BIGNUM_WIDTH;
+		pcCells = _bigDigits[ulValue % 10];
+		for (row = 0; row < 2; row++) {
+			for (i = 0; i < 3; i++) {
+				unsigned char c = *pcCells++;
+				unsigned char *pucCell = &aucCells[row * ucRow + base + i];
+				if (c == 'F')
+					*pucCell = LCD_CHAR_FULL;
+				else if (c == 'U')
+					*pucCell = pWidget->slot + LCD_BIGNUM_UPPER;
+				else if (c == 'L')
+					*pucCell = pWidget->slot + LCD_BIGNUM_LOWER;
+				else if (c == 'B')
+					*pucCell = pWidget->slot + LCD_BIGNUM_BOTH;
+			}
+		}
+		ulValue /= 10;
+	} while (ulValue != 0 && ucDigit > 0);
+	return Lcd_widget_draw(pWidget, aucCells);
+}
+
+//*****************************************************************************
+//
+// Close the Doxygen group.
+//! @}
+//
+//*****************************************************************************
@@ -0,0 +1,309 @@
+/*
+ * i2c_lcd_window.c
+ *
+ *  Layered windows for the i2c_lcd library
+ *
+ *      Each part of the application draws into its own window, a rectangle
+ *      of the screen with a back buffer and a z order, instead of writing
+ *      the screen directly and overwriting the others. Lcd_window_compose
+ *      puts the visible cells of the highest windows into the framebuffer,
+ *      and Lcd_flush or Lcd_service sends only the cells that changed. A
+ *      window opened on top, e.g. an alarm, covers the ones below without
+ *      touching their buffers, so hiding or closing it brings back what was
+ *      underneath without redrawing anything.
+ *
+ *      Usage:
+ *          tLcdWindow status, content, alarm;
+ *          Lcd_window_open(&status, 0, 0, 16, 1, 1);
+ *          Lcd_window_open(&content, 0, 1, 16, 1, 0);
+ *          Lcd_window_open(&alarm, 2, 0, 12, 2, 9);
+ *          Lcd_window_show(&alarm, DISABLE);
+ *
+ *          Lcd_window_gotoxy(&status, 0, 0);
+ *          Lcd_window_print(&status, "%2d:%02d", h, m);
+ *          ...
+ *          Lcd_window_compose();
+ *          Lcd_service();
+ *
+ *      The window functions act on the selected display. Cells covered by
+ *      no window keep what Lcd_Print wrote, until a window above them is
+ *      hidden or closed, which blanks them. The text is stored as character
+ *      codes, as with Lcd_putc, without the Lcd_rom translation.
+ */
+//*****************************************************************************
+//
+//! @{
+//
+//*****************************************************************************
+#include <stdarg.h>
+#include <string.h>
+
+#include "i2c_lcd.h"
+
+//*****************************************************************************
+//                      MACRO DEFINITIONS
+//*****************************************************************************
+#define FAILURE                 -1
+#define SUCCESS                 0
+#define LCD_CHAR_EMPTY          ' '
+
+//****************************************************************************
+//                      LOCAL FUNCTION DEFINITIONS
+//****************************************************************************
+
+//****************************************************************************
+//
+//! Compose a rectangle of the screen
+//!
+//! \param pWin: window whose cells are composed
+//!
+//! This function
+//!    1. Takes each cell from the highest visible window covering it, or
+//!		  blanks it when no window does
+//!    2. Writes the cells that differ into the framebuffer
+//!
+//! \return number of framebuffer cells changed
+//
+//****************************************************************************
+static int Lcd_window_paint(const tLcdWindow *pWin) {
+	tLcd *pLcd = Lcd_selected();
+	const tLcdWindow *pIter;
+	unsigned char x, y, c;
+	int iCount = 0;
+
+	for (y = pWin->y; y < pWin->y + pWin->rows; y++) {
+		for (x = pWin->x; x < pWin->x + pWin->cols; x++) {
+			c = LCD_CHAR_EMPTY;
+			for (pIter = pLcd->windows; pIter != NULL; pIter = pIter->next) {
+				if (pIter->visible == ENABLE && x >= pIter->x
+						&& x < pIter->x + pIter->cols && y >= pIter->y
+						&& y < pIter->y + pIter->rows) {
+					c = pIter->cells[(y - pIter->y) * pIter->cols + x - pIter->x];
+					break;
+				}
+			}
+			if (pLcd->fb[y][x] != c) {
+				pLcd->fb[y][x] = c;
+				iCount++;
+			}
+		}
+	}
+	if (iCount)
+		pLcd->frameDirty = 1;
+	return iCount;
+}
+
+//****************************************************************************
+//
+//! Take a window out of the list of the selected display
+//!
+//! \return 1 when the window was in the list
+//
+//****************************************************************************
+static int Lcd_window_unlink(tLcdWindow *pWin) {
+	tLcdWindow **ppIter;
+
+	for (ppIter = &Lcd_selected()->windows; *ppIter != NULL;
+			ppIter = &(*ppIter)->next) {
+		if (*ppIter == pWin) {
+			*ppIter = pWin->next;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//****************************************************************************
+//
+//! Open a window
+//!
+//! \param pWin: window, owned by the application until Lcd_window_close
+//! \param x: first column
+//! \param y: first row
+//! \param cols: width
+//! \param rows: height, cols * rows up to LCD_WINDOW_CELLS
+//! \param z: order, the highest window shows on the cells it shares with
+//!		   others, the last one opened wins between equal orders
+//!
+//! This function
+//!    1. Clears the window buffer and adds the window, visible, to the
+//!		  selected display
+//!    2. Turns on framebuffer mode, the screen is sent by Lcd_flush or
+//!		  Lcd_service
+//!
+//! \return failure when the window does not fit the screen or the buffer,
+//!		   success otherwise
+//!
+//****************************************************************************
+int Lcd_window_open(tLcdWindow *pWin, unsigned char x, unsigned char y,
+		unsigned char cols, unsigned char rows, unsigned char z) {
+	tLcd *pLcd = Lcd_selected();
+	tLcdWindow **ppIter;
+
+	if (cols == 0 || rows == 0 || x + cols > pLcd->cols
+			|| y + rows > pLcd->rows || cols * rows > LCD_WINDOW_CELLS)
+		return FAILURE;
+	if (Lcd_window_unlink(pWin))
+		Lcd_window_paint(pWin);
+	pWin->x = x;
+	pWin->y = y;
+	pWin->cols = cols;
+	pWin->rows = rows;
+	pWin->z = z;
+	pWin->visible = ENABLE;
+	pWin->curx = 0;
+	pWin->cury = 0;
+	memset(pWin->cells, LCD_CHAR_EMPTY, sizeof(pWin->cells));
+	for (ppIter = &pLcd->windows; *ppIter != NULL && (*ppIter)->z > z;
+			ppIter = &(*ppIter)->next)
+		;
+	pWin->next = *ppIter;
+	*ppIter = pWin;
+	pWin->dirty = 1;
+	Lcd_framebuffer(ENABLE);
+	return SUCCESS;
+}
+
+//****************************************************************************
+//
+//! Close a window
+//!
+//! \param pWin: window opened on the selected display
+//!
+//! This function
+//!    1. Removes the window and composes its cells from the windows below
+//!
+//****************************************************************************
+void Lcd_window_close(tLcdWindow *pWin) {
+	if (Lcd_window_unlink(pWin))
+		Lcd_window_paint(pWin);
+}
+
+//****************************************************************************
+//
+//! Show or hide a window
+//!
+//! \param pWin: window
+//! \param value: ENABLE shows the window, DISABLE hides it and uncovers
+//!		   the windows below at the next Lcd_window_compose
+//!
+//! \Note: a hidden window keeps its buffer and can still be printed to.
+//!
+//****************************************************************************
+void Lcd_window_show(tLcdWindow *pWin, unsigned char value) {
+	value = (value == ENABLE) ? ENABLE : DISABLE;
+	if (pWin->visible != value) {
+		pWin->visible = value;
+		pWin->dirty = 1;
+	}
+}
+
+//****************************************************************************
+//
+//! Clear a window
+//!
+//! \param pWin: window
+//!
+//! This function
+//!    1. Blanks the window buffer and moves its text position home
+//!
+//****************************************************************************
+void Lcd_window_clear(tLcdWindow *pWin) {
+	memset(pWin->cells, LCD_CHAR_EMPTY, sizeof(pWin->cells));
+	pWin->curx = 0;
+	pWin->cury = 0;
+	pWin->dirty = 1;
+}
+
+//****************************************************************************
+//
+//! Set the text position of a window
+//!
+//! \param pWin: window
+//! \param x: column inside the window
+//! \param y: row inside the window
+//!
+//****************************************************************************
+void Lcd_window_gotoxy(tLcdWindow *pWin, unsigned char x, unsigned char y) {
+	pWin->curx = x;
+	pWin->cury = y;
+}
+
+//****************************************************************************
+//
+//! Print into a window
+//!
+//! \param pWin: window
+//! \param pcFormat: Lcd_Print format, '\n' goes to the start of the next
+//!		   window row
+//!
+//! This function
+//!    1. Writes the text into the window buffer at its text position, cut
+//!		  at the right edge of the window
+//!    2. Marks the window for Lcd_window_compose when a cell changed
+//!
+//! \return number of characters written into the buffer
+//!
+//****************************************************************************
+int Lcd_window_print(tLcdWindow *pWin, const char *pcFormat, ...) {
+	char acBuff[LCD_WINDOW_CELLS + 1];
+	unsigned char *pucCell;
+	va_list list;
+	int iLen, i;
+	int iCount = 0;
+
+	va_start(list, pcFormat);
+	iLen = Lcd_vformat(acBuff, sizeof(acBuff), pcFormat, list);
+	va_end(list);
+	for (i = 0; i < iLen; i++) {
+		if (acBuff[i] == '\n') {
+			pWin->curx = 0;
+			pWin->cury++;
+			continue;
+		}
+		if (pWin->curx < pWin->cols && pWin->cury < pWin->rows) {
+			pucCell = &pWin->cells[pWin->cury * pWin->cols + pWin->curx];
+			if (*pucCell != (unsigned char)acBuff[i]) {
+				*pucCell = acBuff[i];
+				pWin->dirty = 1;
+			}
+			iCount++;
+		}
+		pWin->curx++;
+	}
+	return iCount;
+}
+
+//****************************************************************************
+//
+//! Compose the windows
+//!
+//! This function
+//!    1. Composes the cells of every window of the selected display that
+//!		  changed, was shown or hidden since the last call, into the
+//!		  framebuffer
+//!    2. Leaves the sending to Lcd_flush or Lcd_service, which send only
+//!		  the cells that differ from the lcd
+//!
+//! \return number of framebuffer cells changed
+//!
+//****************************************************************************
+int Lcd_window_compose() {
+	tLcdWindow *pWin;
+	int iCount = 0;
+
+	for (pWin = Lcd_selected()->windows; pWin != NULL; pWin = pWin->next) {
+		if (pWin->dirty) {
+			iCount += Lcd_window_paint(pWin);
+			pWin->dirty = 0;
+		}
+	}
+	return iCount;
+}
+
+//*****************************************************************************
+//
+// Close the Doxygen group.
+//! @}
+//
+//*****************************************************************************